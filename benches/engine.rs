@@ -0,0 +1,138 @@
+use criterion::{black_box, criterion_group, criterion_main, Criterion};
+use std::rc::Rc;
+
+use serpens::ast::Ast;
+use serpens::interpreter::Interpreter;
+use serpens::lexer::Lexer;
+use serpens::parser::Parser;
+use serpens::resolver::Resolver;
+use serpens::token::Token;
+use serpens::vm;
+
+/// Tight integer arithmetic, the shape of our numeric inner loops.
+const ARITHMETIC: &str = r#"
+let a = 0
+let b = 1
+let n = 0
+while n < 500 {
+    let c = a + b
+    a = b
+    b = c
+    n = n + 1
+}
+"#;
+
+/// String building by repeated concatenation.
+const STRINGS: &str = r#"
+let s = ""
+let i = 0
+while i < 200 {
+    s = s + "xyz"
+    i = i + 1
+}
+"#;
+
+/// Closure-heavy code, modelled on the `deco` wrapper in test.sp.
+const CLOSURES: &str = r#"
+def deco(tag) {
+    def wrapper(func) {
+        def inner(a, b) {
+            let res = func(a, b)
+            return res
+        }
+        return inner
+    }
+    return wrapper
+}
+let add = deco("add")(|a, b| { return a + b; })
+let i = 0
+let total = 0
+while i < 100 {
+    total = total + add(i, i)
+    i = i + 1
+}
+"#;
+
+const WORKLOADS: [(&str, &str); 3] = [
+    ("arithmetic", ARITHMETIC),
+    ("strings", STRINGS),
+    ("closures", CLOSURES),
+];
+
+fn lex(source: &str) -> Vec<Token> {
+    let mut lexer = Lexer::new(source.to_string(), "<bench>");
+    lexer.lex().expect("lexing failed")
+}
+
+fn parse(source: &str) -> Rc<Ast> {
+    let mut parser = Parser::new(lex(source));
+    Rc::new(parser.parse().expect("parsing failed"))
+}
+
+fn bench_lexer(c: &mut Criterion) {
+    let mut group = c.benchmark_group("lexer");
+    // A larger input so throughput dominates over per-call setup.
+    let large = ARITHMETIC.repeat(100);
+    group.bench_function("large", |b| {
+        b.iter(|| {
+            let mut lexer = Lexer::new(black_box(large.clone()), "<bench>");
+            lexer.lex().expect("lexing failed")
+        })
+    });
+    group.finish();
+}
+
+fn bench_parser(c: &mut Criterion) {
+    let mut group = c.benchmark_group("parser");
+    for (name, source) in WORKLOADS {
+        let tokens = lex(source);
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                let mut parser = Parser::new(black_box(tokens.clone()));
+                parser.parse().expect("parsing failed")
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_interpreter(c: &mut Criterion) {
+    let mut group = c.benchmark_group("interpreter");
+    for (name, source) in WORKLOADS {
+        let ast = parse(source);
+        Resolver::resolve(&ast);
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                let mut interpreter = Interpreter::new();
+                interpreter.execute(black_box(&ast)).expect("execution failed")
+            })
+        });
+    }
+    group.finish();
+}
+
+fn bench_vm(c: &mut Criterion) {
+    let mut group = c.benchmark_group("vm");
+    for (name, source) in WORKLOADS {
+        let ast = parse(source);
+        let chunk = Rc::new(
+            vm::compiler::Compiler::compile_program(&ast).expect("compilation failed"),
+        );
+        group.bench_function(name, |b| {
+            b.iter(|| {
+                let mut vm = vm::Vm::new();
+                vm.run(black_box(chunk.clone())).expect("execution failed")
+            })
+        });
+    }
+    group.finish();
+}
+
+criterion_group!(
+    benches,
+    bench_lexer,
+    bench_parser,
+    bench_interpreter,
+    bench_vm
+);
+criterion_main!(benches);
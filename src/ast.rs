@@ -1,64 +1,160 @@
 use crate::common::Span;
-use std::rc::Rc;
+use crate::symbol::Symbol;
+use std::cell::Cell;
 
-#[derive(Debug)]
+/// Filled in by the resolver: how many scopes up the variable lives, and its
+/// slot index there. `None` means the interpreter falls back to name lookup.
+pub type SlotRef = Cell<Option<(u16, u16)>>;
+
+/// Slot index of a declaration in the scope it executes in.
+pub type DeclSlot = Cell<Option<u16>>;
+
+/// Whether a block needs its own scope at runtime. Defaults to true; the
+/// resolver clears it for blocks that declare nothing.
+pub type NeedsScope = Cell<bool>;
+
+pub fn needs_scope_default() -> NeedsScope {
+    Cell::new(true)
+}
+
+/// Index of a node in its `Ast` arena.
+#[derive(Debug, Clone, Copy, PartialEq, Eq)]
+pub struct NodeId(u32);
+
+impl NodeId {
+    /// Raw arena index; used by the compiled-script cache.
+    pub(crate) fn index(self) -> u32 {
+        self.0
+    }
+
+    pub(crate) fn from_index(index: u32) -> NodeId {
+        NodeId(index)
+    }
+}
+
+/// Arena owning every node of one parse. Nodes are stored contiguously and
+/// reference their children by `NodeId`, so parsing a file is a handful of
+/// bulk allocations and walking the tree touches sequential memory instead
+/// of chasing per-node heap pointers.
+#[derive(Debug, Default)]
+pub struct Ast {
+    nodes: Vec<AST>,
+    root: Option<NodeId>,
+}
+
+impl Ast {
+    pub fn new() -> Ast {
+        Ast::default()
+    }
+
+    pub fn len(&self) -> usize {
+        self.nodes.len()
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.nodes.is_empty()
+    }
+
+    pub fn add(&mut self, node: AST) -> NodeId {
+        let id = NodeId(self.nodes.len() as u32);
+        self.nodes.push(node);
+        id
+    }
+
+    pub fn root(&self) -> NodeId {
+        self.root.expect("arena has no root set")
+    }
+
+    pub fn set_root(&mut self, root: NodeId) {
+        self.root = Some(root);
+    }
+
+    /// Replace a node in place; used by the optimizer to fold subtrees.
+    pub fn replace(&mut self, id: NodeId, node: AST) {
+        self.nodes[id.0 as usize] = node;
+    }
+
+    /// A printable form of the expression rooted at `id`.
+    pub fn display(&self, id: NodeId) -> AstDisplay<'_> {
+        AstDisplay { ast: self, id }
+    }
+}
+
+impl std::ops::Index<NodeId> for Ast {
+    type Output = AST;
+
+    fn index(&self, id: NodeId) -> &AST {
+        &self.nodes[id.0 as usize]
+    }
+}
+
+#[derive(Debug, Clone)]
 pub enum AST {
-    And(Span, Rc<AST>, Rc<AST>),
-    Assert(Span, Rc<AST>),
-    Assignment(Span, Rc<AST>, Rc<AST>),
-    Block(Span, Vec<Rc<AST>>),
+    And(Span, NodeId, NodeId),
+    Assert(Span, NodeId),
+    Assignment(Span, NodeId, NodeId),
+    Block(Span, Vec<NodeId>, NeedsScope),
     BooleanLiteral(Span, bool),
-    Call(Span, Rc<AST>, Vec<Rc<AST>>),
-    Divide(Span, Rc<AST>, Rc<AST>),
+    Call(Span, NodeId, Vec<NodeId>),
+    Divide(Span, NodeId, NodeId),
     FloatLiteral(Span, f64),
     Function {
         span: Span,
-        name: Option<String>,
-        args: Vec<String>,
-        body: Rc<AST>,
+        name: Option<Symbol>,
+        args: Vec<Symbol>,
+        body: NodeId,
+        slot: DeclSlot,
     },
-    If(Span, Rc<AST>, Rc<AST>, Option<Rc<AST>>),
-    Index(Span, Rc<AST>, Rc<AST>),
+    If(Span, NodeId, NodeId, Option<NodeId>),
+    Index(Span, NodeId, NodeId),
     IntegerLiteral(Span, i64),
-    Minus(Span, Rc<AST>, Rc<AST>),
-    Multiply(Span, Rc<AST>, Rc<AST>),
-    Not(Span, Rc<AST>),
+    Minus(Span, NodeId, NodeId),
+    Multiply(Span, NodeId, NodeId),
+    Not(Span, NodeId),
     Nothing(Span),
-    Or(Span, Rc<AST>, Rc<AST>),
-    Plus(Span, Rc<AST>, Rc<AST>),
-    Return(Span, Rc<AST>),
+    Or(Span, NodeId, NodeId),
+    Plus(Span, NodeId, NodeId),
+    Return(Span, NodeId),
     Slice {
         span: Span,
-        lhs: Rc<AST>,
-        start: Option<Rc<AST>>,
-        end: Option<Rc<AST>>,
-        step: Option<Rc<AST>>,
+        lhs: NodeId,
+        start: Option<NodeId>,
+        end: Option<NodeId>,
+        step: Option<NodeId>,
     },
     StringLiteral(Span, String),
-    VarDeclaration(Span, String, Rc<AST>),
-    Variable(Span, String),
-    Equals(Span, Rc<AST>, Rc<AST>),
-    NotEquals(Span, Rc<AST>, Rc<AST>),
-    LessThan(Span, Rc<AST>, Rc<AST>),
-    GreaterThan(Span, Rc<AST>, Rc<AST>),
-    LessEquals(Span, Rc<AST>, Rc<AST>),
-    GreaterEquals(Span, Rc<AST>, Rc<AST>),
-    While(Span, Rc<AST>, Rc<AST>),
+    VarDeclaration(Span, Symbol, NodeId, DeclSlot),
+    Variable(Span, Symbol, SlotRef),
+    Equals(Span, NodeId, NodeId),
+    NotEquals(Span, NodeId, NodeId),
+    LessThan(Span, NodeId, NodeId),
+    GreaterThan(Span, NodeId, NodeId),
+    LessEquals(Span, NodeId, NodeId),
+    GreaterEquals(Span, NodeId, NodeId),
+    While(Span, NodeId, NodeId),
     Continue(Span),
     Break(Span),
-    ForEach(Span, String, Rc<AST>, Rc<AST>),
+    ForEach(Span, Symbol, NodeId, NodeId, DeclSlot),
     For {
         span: Span,
-        init: Option<Rc<AST>>,
-        cond: Option<Rc<AST>>,
-        step: Option<Rc<AST>>,
-        body: Rc<AST>,
+        init: Option<NodeId>,
+        cond: Option<NodeId>,
+        step: Option<NodeId>,
+        body: NodeId,
     },
-    Range(Span, Rc<AST>, Rc<AST>),
+    Range(Span, NodeId, NodeId),
 
-    PostIncrement(Span, Rc<AST>, i64),
-    PreIncrement(Span, Rc<AST>, i64),
-    ArrayLiteral(Span, Vec<Rc<AST>>),
+    PostIncrement(Span, NodeId, i64),
+    PreIncrement(Span, NodeId, i64),
+    ArrayLiteral(Span, Vec<NodeId>),
+    DictLiteral(Span, Vec<(NodeId, NodeId)>),
+    /// `par for x in iterable { ... }`: the body runs across a worker pool
+    /// and the construct evaluates to the array of per-iteration results.
+    ParForEach(Span, Symbol, NodeId, NodeId),
+    /// `import "path.sp"`: runs the module (once) and brings its top-level
+    /// bindings into the importing scope. The path is relative to the
+    /// importing file.
+    Import(Span, String),
 }
 
 impl AST {
@@ -102,45 +198,59 @@ impl AST {
             AST::PostIncrement(span, ..) => span,
             AST::PreIncrement(span, ..) => span,
             AST::ArrayLiteral(span, ..) => span,
+            AST::DictLiteral(span, ..) => span,
+            AST::ParForEach(span, ..) => span,
+            AST::Import(span, ..) => span,
         }
     }
 }
 
-impl std::fmt::Display for AST {
+/// Formats the expression rooted at a node; see `Ast::display`.
+pub struct AstDisplay<'a> {
+    ast: &'a Ast,
+    id: NodeId,
+}
+
+impl std::fmt::Display for AstDisplay<'_> {
     fn fmt(&self, f: &mut std::fmt::Formatter) -> std::fmt::Result {
-        match self {
-            AST::And(_, lhs, rhs) => write!(f, "({} and {})", lhs, rhs),
-            AST::Assert(_, expr) => write!(f, "assert {}", expr),
-            AST::Assignment(_, lhs, rhs) => write!(f, "{} = {}", lhs, rhs),
-            AST::Block(_, exprs) => write!(f, "<block with {} exprs>", exprs.len()),
+        macro_rules! d {
+            ($id:expr) => {
+                self.ast.display(*$id)
+            };
+        }
+        match &self.ast[self.id] {
+            AST::And(_, lhs, rhs) => write!(f, "({} and {})", d!(lhs), d!(rhs)),
+            AST::Assert(_, expr) => write!(f, "assert {}", d!(expr)),
+            AST::Assignment(_, lhs, rhs) => write!(f, "{} = {}", d!(lhs), d!(rhs)),
+            AST::Block(_, exprs, _) => write!(f, "<block with {} exprs>", exprs.len()),
             AST::BooleanLiteral(_, val) => write!(f, "{}", val),
             AST::Call(_, func, args) => {
-                write!(f, "{}(", func)?;
+                write!(f, "{}(", d!(func))?;
                 for (i, arg) in args.iter().enumerate() {
                     if i > 0 {
                         write!(f, ", ")?;
                     }
-                    write!(f, "{}", arg)?;
+                    write!(f, "{}", d!(arg))?;
                 }
                 write!(f, ")")
             }
-            AST::Divide(_, lhs, rhs) => write!(f, "({} / {})", lhs, rhs),
+            AST::Divide(_, lhs, rhs) => write!(f, "({} / {})", d!(lhs), d!(rhs)),
             AST::FloatLiteral(_, val) => write!(f, "{}", val),
             AST::Function { name, .. } => write!(
                 f,
                 "def {} => ...",
-                name.clone().unwrap_or_else(|| "<anon>".to_string())
+                name.map_or("<anon>", |name| name.as_str())
             ),
-            AST::If(_, cond, ..) => write!(f, "if {}", cond),
-            AST::Index(_, lhs, rhs) => write!(f, "{}[{}]", lhs, rhs),
+            AST::If(_, cond, ..) => write!(f, "if {}", d!(cond)),
+            AST::Index(_, lhs, rhs) => write!(f, "{}[{}]", d!(lhs), d!(rhs)),
             AST::IntegerLiteral(_, val) => write!(f, "{}", val),
-            AST::Minus(_, lhs, rhs) => write!(f, "({} - {})", lhs, rhs),
-            AST::Multiply(_, lhs, rhs) => write!(f, "({} * {})", lhs, rhs),
-            AST::Not(_, expr) => write!(f, "not {}", expr),
+            AST::Minus(_, lhs, rhs) => write!(f, "({} - {})", d!(lhs), d!(rhs)),
+            AST::Multiply(_, lhs, rhs) => write!(f, "({} * {})", d!(lhs), d!(rhs)),
+            AST::Not(_, expr) => write!(f, "not {}", d!(expr)),
             AST::Nothing(_) => write!(f, "nothing"),
-            AST::Or(_, lhs, rhs) => write!(f, "({} or {})", lhs, rhs),
-            AST::Plus(_, lhs, rhs) => write!(f, "({} + {})", lhs, rhs),
-            AST::Return(_, expr) => write!(f, "return {}", expr),
+            AST::Or(_, lhs, rhs) => write!(f, "({} or {})", d!(lhs), d!(rhs)),
+            AST::Plus(_, lhs, rhs) => write!(f, "({} + {})", d!(lhs), d!(rhs)),
+            AST::Return(_, expr) => write!(f, "return {}", d!(expr)),
             AST::Slice {
                 lhs,
                 start,
@@ -148,60 +258,76 @@ impl std::fmt::Display for AST {
                 step,
                 ..
             } => {
-                write!(f, "{}[", lhs)?;
+                write!(f, "{}[", d!(lhs))?;
                 if let Some(start) = start {
-                    write!(f, "{}", start)?;
+                    write!(f, "{}", d!(start))?;
                 }
                 write!(f, ":")?;
                 if let Some(end) = end {
-                    write!(f, "{}", end)?;
+                    write!(f, "{}", d!(end))?;
                 }
                 if let Some(step) = step {
-                    write!(f, ":{}", step)?;
+                    write!(f, ":{}", d!(step))?;
                 }
                 write!(f, "]")
             }
             AST::StringLiteral(_, val) => write!(f, "\"{}\"", val),
-            AST::VarDeclaration(_, name, expr) => write!(f, "let {} = {}", name, expr),
-            AST::Variable(_, name) => write!(f, "{}", name),
-            AST::Equals(_, lhs, rhs) => write!(f, "({} == {})", lhs, rhs),
-            AST::NotEquals(_, lhs, rhs) => write!(f, "({} != {})", lhs, rhs),
-            AST::LessThan(_, lhs, rhs) => write!(f, "({} < {})", lhs, rhs),
-            AST::GreaterThan(_, lhs, rhs) => write!(f, "({} > {})", lhs, rhs),
-            AST::LessEquals(_, lhs, rhs) => write!(f, "({} <= {})", lhs, rhs),
-            AST::GreaterEquals(_, lhs, rhs) => write!(f, "({} >= {})", lhs, rhs),
-            AST::While(_, cond, ..) => write!(f, "while {}", cond),
+            AST::VarDeclaration(_, name, expr, _) => write!(f, "let {} = {}", name, d!(expr)),
+            AST::Variable(_, name, _) => write!(f, "{}", name),
+            AST::Equals(_, lhs, rhs) => write!(f, "({} == {})", d!(lhs), d!(rhs)),
+            AST::NotEquals(_, lhs, rhs) => write!(f, "({} != {})", d!(lhs), d!(rhs)),
+            AST::LessThan(_, lhs, rhs) => write!(f, "({} < {})", d!(lhs), d!(rhs)),
+            AST::GreaterThan(_, lhs, rhs) => write!(f, "({} > {})", d!(lhs), d!(rhs)),
+            AST::LessEquals(_, lhs, rhs) => write!(f, "({} <= {})", d!(lhs), d!(rhs)),
+            AST::GreaterEquals(_, lhs, rhs) => write!(f, "({} >= {})", d!(lhs), d!(rhs)),
+            AST::While(_, cond, ..) => write!(f, "while {}", d!(cond)),
             AST::Continue(_) => write!(f, "continue"),
             AST::Break(_) => write!(f, "break"),
-            AST::ForEach(_, name, iter, ..) => write!(f, "for {} in {}", name, iter),
-            AST::For{init, cond, step, .. } => {
+            AST::ForEach(_, name, iter, ..) => write!(f, "for {} in {}", name, d!(iter)),
+            AST::For { init, cond, step, .. } => {
                 write!(f, "for (")?;
                 if let Some(init) = init {
-                    write!(f, "{}", init)?;
+                    write!(f, "{}", d!(init))?;
                 }
                 write!(f, "; ")?;
                 if let Some(cond) = cond {
-                    write!(f, "{}", cond)?;
+                    write!(f, "{}", d!(cond))?;
                 }
                 write!(f, "; ")?;
                 if let Some(step) = step {
-                    write!(f, "{}", step)?;
+                    write!(f, "{}", d!(step))?;
                 }
                 write!(f, ")")
-            },
-            AST::Range(_, start, end) => write!(f, "{}..{}", start, end),
-            AST::PostIncrement(_, expr, offset) => write!(f, "{}{}", expr, if *offset == 1 { "++" } else { "--" }),
-            AST::PreIncrement(_, expr, offset) => write!(f, "{}{}", if *offset == 1 { "++" } else { "--" }, expr),
+            }
+            AST::Range(_, start, end) => write!(f, "{}..{}", d!(start), d!(end)),
+            AST::PostIncrement(_, expr, offset) => {
+                write!(f, "{}{}", d!(expr), if *offset == 1 { "++" } else { "--" })
+            }
+            AST::PreIncrement(_, expr, offset) => {
+                write!(f, "{}{}", if *offset == 1 { "++" } else { "--" }, d!(expr))
+            }
             AST::ArrayLiteral(_, exprs) => {
                 write!(f, "[")?;
                 for (i, expr) in exprs.iter().enumerate() {
                     if i > 0 {
                         write!(f, ", ")?;
                     }
-                    write!(f, "{}", expr)?;
+                    write!(f, "{}", d!(expr))?;
                 }
                 write!(f, "]")
             }
+            AST::ParForEach(_, name, iter, _) => write!(f, "par for {} in {}", name, d!(iter)),
+            AST::Import(_, path) => write!(f, "import {:?}", path),
+            AST::DictLiteral(_, pairs) => {
+                write!(f, "{{")?;
+                for (i, (key, value)) in pairs.iter().enumerate() {
+                    if i > 0 {
+                        write!(f, ", ")?;
+                    }
+                    write!(f, "{}: {}", d!(key), d!(value))?;
+                }
+                write!(f, "}}")
+            }
         }
     }
 }
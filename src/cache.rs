@@ -0,0 +1,620 @@
+use crate::ast::{needs_scope_default, Ast, NodeId, AST};
+use crate::common::{Location, Span};
+use crate::symbol::Symbol;
+use std::cell::Cell;
+use std::collections::HashMap;
+use std::hash::Hasher;
+
+/// On-disk cache of a parsed (and optimized) script, written beside the
+/// source as `foo.spc`. The file is keyed on a hash of the source text, so a
+/// stale cache is simply ignored and rewritten; any decode failure is
+/// likewise treated as a miss. Spans store only line/column — the filename
+/// is reinstated on load — and symbols go through a small string table so
+/// each name is stored once.
+const MAGIC: &[u8; 4] = b"SPC\x02";
+
+pub fn source_hash(source: &str) -> u64 {
+    let mut hasher = rustc_hash::FxHasher::default();
+    hasher.write(source.as_bytes());
+    hasher.finish()
+}
+
+/// Cache path for a script: `foo.sp` becomes `foo.spc`.
+pub fn cache_path(filename: &str) -> String {
+    match filename.strip_suffix(".sp") {
+        Some(stem) => format!("{}.spc", stem),
+        None => format!("{}.spc", filename),
+    }
+}
+
+struct Writer {
+    bytes: Vec<u8>,
+    symbols: Vec<Symbol>,
+    symbol_ids: HashMap<Symbol, u32>,
+}
+
+impl Writer {
+    fn new() -> Writer {
+        Writer {
+            bytes: vec![],
+            symbols: vec![],
+            symbol_ids: HashMap::new(),
+        }
+    }
+
+    fn u8(&mut self, value: u8) {
+        self.bytes.push(value);
+    }
+
+    fn u32(&mut self, value: u32) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn i64(&mut self, value: i64) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn f64(&mut self, value: f64) {
+        self.bytes.extend_from_slice(&value.to_le_bytes());
+    }
+
+    fn bool(&mut self, value: bool) {
+        self.u8(value as u8);
+    }
+
+    fn str(&mut self, value: &str) {
+        self.u32(value.len() as u32);
+        self.bytes.extend_from_slice(value.as_bytes());
+    }
+
+    fn symbol(&mut self, symbol: Symbol) {
+        let next = self.symbols.len() as u32;
+        let id = *self.symbol_ids.entry(symbol).or_insert_with(|| {
+            self.symbols.push(symbol);
+            next
+        });
+        self.u32(id);
+    }
+
+    fn opt_symbol(&mut self, symbol: &Option<Symbol>) {
+        match symbol {
+            Some(symbol) => {
+                self.u8(1);
+                self.symbol(*symbol);
+            }
+            None => self.u8(0),
+        }
+    }
+
+    fn node(&mut self, id: NodeId) {
+        self.u32(id.index());
+    }
+
+    fn opt_node(&mut self, id: &Option<NodeId>) {
+        match id {
+            Some(id) => {
+                self.u8(1);
+                self.node(*id);
+            }
+            None => self.u8(0),
+        }
+    }
+
+    fn node_list(&mut self, ids: &[NodeId]) {
+        self.u32(ids.len() as u32);
+        for id in ids {
+            self.node(*id);
+        }
+    }
+
+    fn span(&mut self, span: &Span) {
+        self.u32(span.0.line as u32);
+        self.u32(span.0.column as u32);
+        self.u32(span.1.line as u32);
+        self.u32(span.1.column as u32);
+    }
+}
+
+struct Reader<'a> {
+    bytes: &'a [u8],
+    pos: usize,
+    symbols: Vec<Symbol>,
+    /// Total nodes in the arena being decoded; any `NodeId` at or past this
+    /// marks the payload as corrupt.
+    node_count: u32,
+    filename: &'static str,
+}
+
+impl<'a> Reader<'a> {
+    fn take(&mut self, len: usize) -> Option<&'a [u8]> {
+        let slice = self.bytes.get(self.pos..self.pos + len)?;
+        self.pos += len;
+        Some(slice)
+    }
+
+    fn u8(&mut self) -> Option<u8> {
+        Some(self.take(1)?[0])
+    }
+
+    fn u32(&mut self) -> Option<u32> {
+        Some(u32::from_le_bytes(self.take(4)?.try_into().ok()?))
+    }
+
+    fn i64(&mut self) -> Option<i64> {
+        Some(i64::from_le_bytes(self.take(8)?.try_into().ok()?))
+    }
+
+    fn f64(&mut self) -> Option<f64> {
+        Some(f64::from_le_bytes(self.take(8)?.try_into().ok()?))
+    }
+
+    fn bool(&mut self) -> Option<bool> {
+        Some(self.u8()? != 0)
+    }
+
+    fn str(&mut self) -> Option<String> {
+        let len = self.u32()? as usize;
+        String::from_utf8(self.take(len)?.to_vec()).ok()
+    }
+
+    fn symbol(&mut self) -> Option<Symbol> {
+        let id = self.u32()? as usize;
+        self.symbols.get(id).copied()
+    }
+
+    fn opt_symbol(&mut self) -> Option<Option<Symbol>> {
+        Some(match self.u8()? {
+            0 => None,
+            _ => Some(self.symbol()?),
+        })
+    }
+
+    fn node(&mut self) -> Option<NodeId> {
+        let index = self.u32()?;
+        if index >= self.node_count {
+            return None;
+        }
+        Some(NodeId::from_index(index))
+    }
+
+    fn opt_node(&mut self) -> Option<Option<NodeId>> {
+        Some(match self.u8()? {
+            0 => None,
+            _ => Some(self.node()?),
+        })
+    }
+
+    fn node_list(&mut self) -> Option<Vec<NodeId>> {
+        let len = self.u32()? as usize;
+        (0..len).map(|_| self.node()).collect()
+    }
+
+    fn span(&mut self) -> Option<Span> {
+        let (l0, c0) = (self.u32()? as usize, self.u32()? as usize);
+        let (l1, c1) = (self.u32()? as usize, self.u32()? as usize);
+        let filename = self.filename;
+        Some(Span(
+            Location { line: l0, column: c0, filename },
+            Location { line: l1, column: c1, filename },
+        ))
+    }
+}
+
+fn write_node(w: &mut Writer, node: &AST) {
+    // Tags follow the enum's declaration order. Resolver-filled `Cell`s
+    // (slots, needs_scope) are not stored; the resolver reruns after a load.
+    match node {
+        AST::And(span, lhs, rhs) => {
+            w.u8(0);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Assert(span, expr) => {
+            w.u8(1);
+            w.span(span);
+            w.node(*expr);
+        }
+        AST::Assignment(span, lhs, rhs) => {
+            w.u8(2);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Block(span, stmts, _) => {
+            w.u8(3);
+            w.span(span);
+            w.node_list(stmts);
+        }
+        AST::BooleanLiteral(span, value) => {
+            w.u8(4);
+            w.span(span);
+            w.bool(*value);
+        }
+        AST::Call(span, func, args) => {
+            w.u8(5);
+            w.span(span);
+            w.node(*func);
+            w.node_list(args);
+        }
+        AST::Divide(span, lhs, rhs) => {
+            w.u8(6);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::FloatLiteral(span, value) => {
+            w.u8(7);
+            w.span(span);
+            w.f64(*value);
+        }
+        AST::Function { span, name, args, body, .. } => {
+            w.u8(8);
+            w.span(span);
+            w.opt_symbol(name);
+            w.u32(args.len() as u32);
+            for arg in args {
+                w.symbol(*arg);
+            }
+            w.node(*body);
+        }
+        AST::If(span, cond, then, otherwise) => {
+            w.u8(9);
+            w.span(span);
+            w.node(*cond);
+            w.node(*then);
+            w.opt_node(otherwise);
+        }
+        AST::Index(span, lhs, rhs) => {
+            w.u8(10);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::IntegerLiteral(span, value) => {
+            w.u8(11);
+            w.span(span);
+            w.i64(*value);
+        }
+        AST::Minus(span, lhs, rhs) => {
+            w.u8(12);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Multiply(span, lhs, rhs) => {
+            w.u8(13);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Not(span, expr) => {
+            w.u8(14);
+            w.span(span);
+            w.node(*expr);
+        }
+        AST::Nothing(span) => {
+            w.u8(15);
+            w.span(span);
+        }
+        AST::Or(span, lhs, rhs) => {
+            w.u8(16);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Plus(span, lhs, rhs) => {
+            w.u8(17);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::Return(span, expr) => {
+            w.u8(18);
+            w.span(span);
+            w.node(*expr);
+        }
+        AST::Slice { span, lhs, start, end, step } => {
+            w.u8(19);
+            w.span(span);
+            w.node(*lhs);
+            w.opt_node(start);
+            w.opt_node(end);
+            w.opt_node(step);
+        }
+        AST::StringLiteral(span, value) => {
+            w.u8(20);
+            w.span(span);
+            w.str(value);
+        }
+        AST::VarDeclaration(span, name, value, _) => {
+            w.u8(21);
+            w.span(span);
+            w.symbol(*name);
+            w.node(*value);
+        }
+        AST::Variable(span, name, _) => {
+            w.u8(22);
+            w.span(span);
+            w.symbol(*name);
+        }
+        AST::Equals(span, lhs, rhs) => {
+            w.u8(23);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::NotEquals(span, lhs, rhs) => {
+            w.u8(24);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::LessThan(span, lhs, rhs) => {
+            w.u8(25);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::GreaterThan(span, lhs, rhs) => {
+            w.u8(26);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::LessEquals(span, lhs, rhs) => {
+            w.u8(27);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::GreaterEquals(span, lhs, rhs) => {
+            w.u8(28);
+            w.span(span);
+            w.node(*lhs);
+            w.node(*rhs);
+        }
+        AST::While(span, cond, body) => {
+            w.u8(29);
+            w.span(span);
+            w.node(*cond);
+            w.node(*body);
+        }
+        AST::Continue(span) => {
+            w.u8(30);
+            w.span(span);
+        }
+        AST::Break(span) => {
+            w.u8(31);
+            w.span(span);
+        }
+        AST::ForEach(span, name, iterable, body, _) => {
+            w.u8(32);
+            w.span(span);
+            w.symbol(*name);
+            w.node(*iterable);
+            w.node(*body);
+        }
+        AST::For { span, init, cond, step, body } => {
+            w.u8(33);
+            w.span(span);
+            w.opt_node(init);
+            w.opt_node(cond);
+            w.opt_node(step);
+            w.node(*body);
+        }
+        AST::Range(span, start, end) => {
+            w.u8(34);
+            w.span(span);
+            w.node(*start);
+            w.node(*end);
+        }
+        AST::PostIncrement(span, expr, offset) => {
+            w.u8(35);
+            w.span(span);
+            w.node(*expr);
+            w.i64(*offset);
+        }
+        AST::PreIncrement(span, expr, offset) => {
+            w.u8(36);
+            w.span(span);
+            w.node(*expr);
+            w.i64(*offset);
+        }
+        AST::ArrayLiteral(span, exprs) => {
+            w.u8(37);
+            w.span(span);
+            w.node_list(exprs);
+        }
+        AST::DictLiteral(span, pairs) => {
+            w.u8(38);
+            w.span(span);
+            w.u32(pairs.len() as u32);
+            for (key, value) in pairs {
+                w.node(*key);
+                w.node(*value);
+            }
+        }
+        AST::ParForEach(span, name, iterable, body) => {
+            w.u8(39);
+            w.span(span);
+            w.symbol(*name);
+            w.node(*iterable);
+            w.node(*body);
+        }
+        AST::Import(span, path) => {
+            w.u8(40);
+            w.span(span);
+            w.str(path);
+        }
+    }
+}
+
+fn read_node(r: &mut Reader) -> Option<AST> {
+    let tag = r.u8()?;
+    Some(match tag {
+        0 => AST::And(r.span()?, r.node()?, r.node()?),
+        1 => AST::Assert(r.span()?, r.node()?),
+        2 => AST::Assignment(r.span()?, r.node()?, r.node()?),
+        3 => AST::Block(r.span()?, r.node_list()?, needs_scope_default()),
+        4 => AST::BooleanLiteral(r.span()?, r.bool()?),
+        5 => AST::Call(r.span()?, r.node()?, r.node_list()?),
+        6 => AST::Divide(r.span()?, r.node()?, r.node()?),
+        7 => AST::FloatLiteral(r.span()?, r.f64()?),
+        8 => {
+            let span = r.span()?;
+            let name = r.opt_symbol()?;
+            let count = r.u32()? as usize;
+            let args = (0..count).map(|_| r.symbol()).collect::<Option<Vec<_>>>()?;
+            let body = r.node()?;
+            AST::Function { span, name, args, body, slot: Cell::new(None) }
+        }
+        9 => AST::If(r.span()?, r.node()?, r.node()?, r.opt_node()?),
+        10 => AST::Index(r.span()?, r.node()?, r.node()?),
+        11 => AST::IntegerLiteral(r.span()?, r.i64()?),
+        12 => AST::Minus(r.span()?, r.node()?, r.node()?),
+        13 => AST::Multiply(r.span()?, r.node()?, r.node()?),
+        14 => AST::Not(r.span()?, r.node()?),
+        15 => AST::Nothing(r.span()?),
+        16 => AST::Or(r.span()?, r.node()?, r.node()?),
+        17 => AST::Plus(r.span()?, r.node()?, r.node()?),
+        18 => AST::Return(r.span()?, r.node()?),
+        19 => AST::Slice {
+            span: r.span()?,
+            lhs: r.node()?,
+            start: r.opt_node()?,
+            end: r.opt_node()?,
+            step: r.opt_node()?,
+        },
+        20 => AST::StringLiteral(r.span()?, r.str()?),
+        21 => AST::VarDeclaration(r.span()?, r.symbol()?, r.node()?, Cell::new(None)),
+        22 => AST::Variable(r.span()?, r.symbol()?, Cell::new(None)),
+        23 => AST::Equals(r.span()?, r.node()?, r.node()?),
+        24 => AST::NotEquals(r.span()?, r.node()?, r.node()?),
+        25 => AST::LessThan(r.span()?, r.node()?, r.node()?),
+        26 => AST::GreaterThan(r.span()?, r.node()?, r.node()?),
+        27 => AST::LessEquals(r.span()?, r.node()?, r.node()?),
+        28 => AST::GreaterEquals(r.span()?, r.node()?, r.node()?),
+        29 => AST::While(r.span()?, r.node()?, r.node()?),
+        30 => AST::Continue(r.span()?),
+        31 => AST::Break(r.span()?),
+        32 => AST::ForEach(r.span()?, r.symbol()?, r.node()?, r.node()?, Cell::new(None)),
+        33 => AST::For {
+            span: r.span()?,
+            init: r.opt_node()?,
+            cond: r.opt_node()?,
+            step: r.opt_node()?,
+            body: r.node()?,
+        },
+        34 => AST::Range(r.span()?, r.node()?, r.node()?),
+        35 => AST::PostIncrement(r.span()?, r.node()?, r.i64()?),
+        36 => AST::PreIncrement(r.span()?, r.node()?, r.i64()?),
+        37 => AST::ArrayLiteral(r.span()?, r.node_list()?),
+        38 => {
+            let span = r.span()?;
+            let count = r.u32()? as usize;
+            let pairs = (0..count)
+                .map(|_| Some((r.node()?, r.node()?)))
+                .collect::<Option<Vec<_>>>()?;
+            AST::DictLiteral(span, pairs)
+        }
+        39 => AST::ParForEach(r.span()?, r.symbol()?, r.node()?, r.node()?),
+        40 => AST::Import(r.span()?, r.str()?),
+        _ => return None,
+    })
+}
+
+/// Encode an arena (symbol table, nodes, root) without the file header.
+/// Symbols are stored by name, so this is also how `par for` ships an arena
+/// to worker threads, which re-intern on their side.
+pub fn encode(ast: &Ast) -> Vec<u8> {
+    let mut w = Writer::new();
+    for i in 0..ast.len() {
+        write_node(&mut w, &ast[NodeId::from_index(i as u32)]);
+    }
+    w.u32(ast.root().index());
+
+    let mut out = Vec::with_capacity(w.bytes.len() + 64);
+    out.extend_from_slice(&(w.symbols.len() as u32).to_le_bytes());
+    for symbol in &w.symbols {
+        let name = symbol.as_str();
+        out.extend_from_slice(&(name.len() as u32).to_le_bytes());
+        out.extend_from_slice(name.as_bytes());
+    }
+    out.extend_from_slice(&(ast.len() as u32).to_le_bytes());
+    out.extend_from_slice(&w.bytes);
+    out
+}
+
+/// Decode an `encode`d arena; `None` if the bytes are malformed.
+pub fn decode(bytes: &[u8], filename: &'static str) -> Option<Ast> {
+    let mut r = Reader { bytes, pos: 0, symbols: vec![], node_count: 0, filename };
+
+    let symbol_count = r.u32()? as usize;
+    for _ in 0..symbol_count {
+        let name = r.str()?;
+        r.symbols.push(Symbol::intern(&name));
+    }
+
+    // Every node reference (children and root alike) is bounds-checked
+    // against this in `Reader::node`, so a bit-flipped payload whose source
+    // hash still matches reads as a miss instead of an arena index panic.
+    r.node_count = r.u32()?;
+    let mut ast = Ast::new();
+    for _ in 0..r.node_count {
+        let node = read_node(&mut r)?;
+        ast.add(node);
+    }
+    let root = r.node()?;
+    ast.set_root(root);
+    Some(ast)
+}
+
+fn body_hash(body: &[u8]) -> u64 {
+    let mut hasher = rustc_hash::FxHasher::default();
+    hasher.write(body);
+    hasher.finish()
+}
+
+/// Write an already-`encode`d arena to `path`. Failures are ignored: the
+/// cache is an optimization, not a correctness requirement. The header
+/// carries a hash of the body so on-disk corruption reads as a miss.
+pub fn store_payload(path: &str, hash: u64, body: &[u8]) {
+    let mut out = Vec::with_capacity(body.len() + MAGIC.len() + 16);
+    out.extend_from_slice(MAGIC);
+    out.extend_from_slice(&hash.to_le_bytes());
+    out.extend_from_slice(&body_hash(body).to_le_bytes());
+    out.extend_from_slice(body);
+    let _ = std::fs::write(path, out);
+}
+
+/// Write the parsed arena to `path`.
+pub fn store(path: &str, hash: u64, ast: &Ast) {
+    store_payload(path, hash, &encode(ast));
+}
+
+/// The still-encoded arena cached for a source whose hash is `hash`, or
+/// `None` — a cache miss — if the file is absent, stale, or truncated. The
+/// module loader uses this form to move encoded arenas between threads
+/// without touching the (thread-local) symbol interner.
+pub fn load_payload(path: &str, hash: u64) -> Option<Vec<u8>> {
+    let bytes = std::fs::read(path).ok()?;
+    if bytes.len() < MAGIC.len() + 16 || &bytes[..MAGIC.len()] != MAGIC {
+        return None;
+    }
+    let stored = u64::from_le_bytes(bytes[MAGIC.len()..MAGIC.len() + 8].try_into().ok()?);
+    if stored != hash {
+        return None;
+    }
+    let checksum = u64::from_le_bytes(bytes[MAGIC.len() + 8..MAGIC.len() + 16].try_into().ok()?);
+    let body = &bytes[MAGIC.len() + 16..];
+    if checksum != body_hash(body) {
+        return None;
+    }
+    Some(body.to_vec())
+}
+
+/// Load a cached arena for a source whose hash is `hash`.
+pub fn load(path: &str, hash: u64, filename: &'static str) -> Option<Ast> {
+    decode(&load_payload(path, hash)?, filename)
+}
@@ -1,15 +1,77 @@
-use crate::error::{runtime_error as error, Result};
-use crate::interpreter::value::Value;
-use crate::common::Span;
+use crate::error::{runtime_error as error, Error, ErrorKind, Result};
+use crate::interpreter::value::{IteratorValue, Value};
+use crate::interpreter::Interpreter;
+use crate::common::{make, Span};
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::io::{BufRead, Write};
 
-pub fn print(_span: &Span, args: Vec<Value>) -> Result<Value> {
-    for (i, arg) in args.iter().enumerate() {
-        if i != 0 {
-            print!(" ");
+/// Buffer size for the I/O builtins: big enough that streaming a
+/// multi-gigabyte log is bandwidth-bound, and independent of file size, so
+/// memory stays constant however much passes through.
+const IO_BUFFER_SIZE: usize = 1 << 16;
+
+thread_local! {
+    /// Buffered stdout shared by the output builtins. Bytes land here and
+    /// only reach the (locked, line-buffered) real stdout when the buffer
+    /// fills or `flush_output` runs, so output-heavy scripts pay for I/O
+    /// bandwidth instead of a lock and a syscall per line.
+    static STDOUT: RefCell<std::io::BufWriter<std::io::Stdout>> =
+        RefCell::new(std::io::BufWriter::with_capacity(IO_BUFFER_SIZE, std::io::stdout()));
+
+    /// Open output files for `append_file`, keyed by path, so a script
+    /// appending line by line keeps one buffered handle per file instead of
+    /// reopening and syncing on every call.
+    static OUT_FILES: RefCell<HashMap<String, std::io::BufWriter<std::fs::File>>> =
+        RefCell::new(HashMap::new());
+}
+
+/// Flush buffered `print`/`write` output and any open output files. Called
+/// on the interpreter thread before the process exits and whenever an error
+/// surfaces, so buffered output is never lost or misordered relative to
+/// diagnostics.
+pub fn flush_output() {
+    STDOUT.with(|out| {
+        let _ = out.borrow_mut().flush();
+    });
+    OUT_FILES.with(|files| {
+        for file in files.borrow_mut().values_mut() {
+            let _ = file.flush();
+        }
+    });
+}
+
+fn write_values(args: &[Value], newline: bool) {
+    STDOUT.with(|out| {
+        let mut out = out.borrow_mut();
+        for (i, arg) in args.iter().enumerate() {
+            if i != 0 {
+                let _ = out.write_all(b" ");
+            }
+            let _ = write!(out, "{}", arg.repr());
+        }
+        if newline {
+            let _ = out.write_all(b"\n");
         }
-        print!("{}", arg.repr())
+    });
+}
+
+/// The iterator behind any iterable, for the adapter builtins below.
+fn iterate(value: &Value, span: &Span) -> Result<IteratorValue> {
+    match value.iterator(span)? {
+        Value::Iterator(iter) => Ok(iter),
+        _ => unreachable!("Value::iterator returned a non-iterator"),
     }
-    println!();
+}
+
+pub fn print(_span: &Span, args: Vec<Value>) -> Result<Value> {
+    write_values(&args, true);
+    Ok(Value::Nothing)
+}
+
+/// Like `print`, but without the trailing newline.
+pub fn write(_span: &Span, args: Vec<Value>) -> Result<Value> {
+    write_values(&args, false);
     Ok(Value::Nothing)
 }
 
@@ -21,11 +83,80 @@ pub fn len(span: &Span, args: Vec<Value>) -> Result<Value> {
     Ok(match &args[0] {
         Value::String(string) => Value::Integer(string.borrow().len() as i64),
         Value::Array(array) => Value::Integer(array.borrow().len() as i64),
-        Value::Range(start, end) => Value::Integer(end - start),
+        Value::Dict(map) => Value::Integer(map.borrow().len() as i64),
+        Value::Slice(view) => Value::Integer(view.borrow().len() as i64),
+        Value::Range(range) => Value::Integer(range.end - range.start),
         other => error!(span, "len() does not support {:?}", other),
     })
 }
 
+pub fn join(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.is_empty() || args.len() > 2 {
+        error!(span, "join() takes an array and an optional separator");
+    }
+
+    let target = args[0].materialize();
+    let array = match &target {
+        Value::Array(array) => array.borrow(),
+        other => error!(span, "join() expects an array, got {:?}", other),
+    };
+    let separator = match args.get(1) {
+        Some(Value::String(sep)) => sep.borrow().clone(),
+        Some(other) => error!(span, "join() separator must be a string, got {:?}", other),
+        None => String::new(),
+    };
+
+    // Size the output up front so assembly is a single allocation.
+    let mut capacity = separator.len() * array.len().saturating_sub(1);
+    let items = array.iter().map(Value::materialize).collect::<Vec<_>>();
+    for item in &items {
+        match item {
+            Value::String(s) => capacity += s.borrow().len(),
+            other => error!(span, "join() expects an array of strings, got {:?}", other),
+        }
+    }
+
+    let mut out = String::with_capacity(capacity);
+    for (i, item) in items.iter().enumerate() {
+        if i != 0 {
+            out.push_str(&separator);
+        }
+        if let Value::String(s) = item {
+            out.push_str(&s.borrow());
+        }
+    }
+    Ok(Value::String(make!(out)))
+}
+
+pub fn push(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() < 2 {
+        error!(span, "push() takes an array and at least one value");
+    }
+    match &args[0] {
+        Value::Array(array) => {
+            let mut array = array.borrow_mut();
+            // One reservation up front, however many values are appended.
+            array.reserve(args.len() - 1);
+            array.extend(args[1..].iter().cloned());
+        }
+        other => error!(span, "push() expects an array, got {:?}", other),
+    }
+    Ok(Value::Nothing)
+}
+
+pub fn pop(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 1 {
+        error!(span, "pop() takes exactly one argument");
+    }
+    match &args[0] {
+        Value::Array(array) => match array.borrow_mut().pop() {
+            Some(value) => Ok(value),
+            None => error!(span, "pop() from an empty array"),
+        },
+        other => error!(span, "pop() expects an array, got {:?}", other),
+    }
+}
+
 pub fn exit(span: &Span, args: Vec<Value>) -> Result<Value> {
     let code = match args.get(0) {
         Some(val) => match val {
@@ -35,8 +166,472 @@ pub fn exit(span: &Span, args: Vec<Value>) -> Result<Value> {
         None => 0,
     };
 
+    flush_output();
     match code.try_into() {
         Ok(code) => std::process::exit(code),
         Err(_) => std::process::exit(1),
     }
 }
+
+// The adapters below are lazy: each wraps its source in a new
+// `IteratorValue` and only pulls (and only calls the user function) when a
+// consumer asks for the next element, so map/filter chains stream without
+// building intermediate arrays. User functions run on a private tree-walking
+// interpreter, which works under either engine since a `Function` carries
+// its AST and captured scope.
+
+pub fn map(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "map() takes a function and an iterable");
+    }
+    let func = args[0].clone();
+    let iter = iterate(&args[1], span)?;
+    let span = *span;
+    let mut interp = Interpreter::new();
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || {
+            let next = iter.0.borrow_mut().next()?;
+            match next {
+                Ok(item) => Some(interp.call_value(func.clone(), vec![item], &span)),
+                Err(err) => Some(Err(err)),
+            }
+        },
+    ))))
+}
+
+pub fn filter(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "filter() takes a function and an iterable");
+    }
+    let func = args[0].clone();
+    let iter = iterate(&args[1], span)?;
+    let span = *span;
+    let mut interp = Interpreter::new();
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || loop {
+            let next = iter.0.borrow_mut().next()?;
+            let item = match next {
+                Ok(item) => item,
+                Err(err) => return Some(Err(err)),
+            };
+            match interp.call_value(func.clone(), vec![item.clone()], &span) {
+                Ok(Value::Boolean(true)) => return Some(Ok(item)),
+                Ok(Value::Boolean(false)) => {}
+                Ok(other) => {
+                    return Some(Err(Error {
+                        kind: ErrorKind::Runtime,
+                        span,
+                        message: format!(
+                            "filter() predicate must return a boolean, got {:?}",
+                            other
+                        ),
+                    }))
+                }
+                Err(err) => return Some(Err(err)),
+            }
+        },
+    ))))
+}
+
+pub fn zip(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "zip() takes two iterables");
+    }
+    let left = iterate(&args[0], span)?;
+    let right = iterate(&args[1], span)?;
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || {
+            let left = left.0.borrow_mut().next()?;
+            let right = right.0.borrow_mut().next()?;
+            match (left, right) {
+                (Ok(left), Ok(right)) => Some(Ok(Value::Array(make!(vec![left, right])))),
+                (Err(err), _) | (_, Err(err)) => Some(Err(err)),
+            }
+        },
+    ))))
+}
+
+pub fn enumerate(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 1 {
+        error!(span, "enumerate() takes one iterable");
+    }
+    let iter = iterate(&args[0], span)?;
+    let mut index = 0i64;
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || {
+            let next = iter.0.borrow_mut().next()?;
+            match next {
+                Ok(item) => {
+                    let pair = Value::Array(make!(vec![Value::Integer(index), item]));
+                    index += 1;
+                    Some(Ok(pair))
+                }
+                Err(err) => Some(Err(err)),
+            }
+        },
+    ))))
+}
+
+pub fn take(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "take() takes a count and an iterable");
+    }
+    let mut remaining = match &args[0] {
+        Value::Integer(count) => *count,
+        other => error!(span, "take() count must be an integer, got {:?}", other),
+    };
+    let iter = iterate(&args[1], span)?;
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || {
+            if remaining <= 0 {
+                return None;
+            }
+            remaining -= 1;
+            iter.0.borrow_mut().next()
+        },
+    ))))
+}
+
+pub fn sum(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 1 {
+        error!(span, "sum() takes one iterable");
+    }
+    // Homogeneous arrays skip `Value::plus` dispatch: one tag scan, then a
+    // bare accumulation loop. Mixed contents take the generic path below so
+    // int/float promotion keeps its usual semantics.
+    if let Value::Array(array) = &args[0].materialize() {
+        let array = array.borrow();
+        if array.iter().all(|v| matches!(v, Value::Integer(_))) {
+            let mut total = 0i64;
+            for value in array.iter() {
+                if let Value::Integer(n) = value {
+                    total += n;
+                }
+            }
+            return Ok(Value::Integer(total));
+        }
+        if array.iter().all(|v| matches!(v, Value::Float(_))) {
+            let mut total = 0f64;
+            for value in array.iter() {
+                if let Value::Float(n) = value {
+                    total += n;
+                }
+            }
+            return Ok(Value::Float(total));
+        }
+    }
+    let iter = iterate(&args[0], span)?;
+    let mut acc = Value::Integer(0);
+    loop {
+        let next = iter.0.borrow_mut().next();
+        match next {
+            Some(item) => acc = acc.plus(&item?, span)?,
+            None => return Ok(acc),
+        }
+    }
+}
+
+pub fn reduce(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 && args.len() != 3 {
+        error!(span, "reduce() takes a function, an iterable, and an optional initial value");
+    }
+    let func = args[0].clone();
+    let iter = iterate(&args[1], span)?;
+    let mut interp = Interpreter::new();
+    let mut acc = match args.get(2) {
+        Some(init) => init.clone(),
+        None => match iter.0.borrow_mut().next() {
+            Some(item) => item?,
+            None => error!(span, "reduce() of an empty iterable with no initial value"),
+        },
+    };
+    loop {
+        let next = iter.0.borrow_mut().next();
+        match next {
+            Some(item) => acc = interp.call_value(func.clone(), vec![acc, item?], span)?,
+            None => return Ok(acc),
+        }
+    }
+}
+
+/// The raw text of a value for file output: strings as-is, everything else
+/// as its `repr`.
+fn file_text(value: &Value) -> String {
+    match &value.materialize() {
+        Value::String(string) => string.borrow().clone(),
+        other => other.repr(),
+    }
+}
+
+/// `open(path)`: a lazy iterator over the lines of a file, without their
+/// newlines. Lines are pulled through a fixed-size buffer as the loop asks
+/// for them, so `for line in open(path)` streams a file of any size in
+/// constant memory.
+pub fn open(span: &Span, args: Vec<Value>) -> Result<Value> {
+    let path = match &args[..] {
+        [Value::String(path)] => path.borrow().clone(),
+        _ => error!(span, "open() takes a single string path"),
+    };
+    let file = match std::fs::File::open(&path) {
+        Ok(file) => file,
+        Err(err) => error!(span, "Couldn't open {}: {}", path, err),
+    };
+    let mut lines = std::io::BufReader::with_capacity(IO_BUFFER_SIZE, file).lines();
+    let span = *span;
+    Ok(Value::Iterator(IteratorValue::fallible(std::iter::from_fn(
+        move || match lines.next()? {
+            Ok(line) => Some(Ok(Value::String(make!(line)))),
+            Err(err) => Some(Err(Error {
+                kind: ErrorKind::Runtime,
+                span,
+                message: format!("Couldn't read {}: {}", path, err),
+            })),
+        },
+    ))))
+}
+
+/// `read_file(path)`: the whole file as one string.
+pub fn read_file(span: &Span, args: Vec<Value>) -> Result<Value> {
+    let path = match &args[..] {
+        [Value::String(path)] => path.borrow().clone(),
+        _ => error!(span, "read_file() takes a single string path"),
+    };
+    match std::fs::read_to_string(&path) {
+        Ok(content) => Ok(Value::String(make!(content))),
+        Err(err) => error!(span, "Couldn't read {}: {}", path, err),
+    }
+}
+
+/// `write_file(path, values...)`: replace the file's contents with the
+/// values, space-separated, and close it. Discards any buffered
+/// `append_file` handle for the same path first, so the two compose.
+pub fn write_file(span: &Span, args: Vec<Value>) -> Result<Value> {
+    let path = match args.first() {
+        Some(Value::String(path)) if args.len() >= 2 => path.borrow().clone(),
+        _ => error!(span, "write_file() takes a string path and at least one value"),
+    };
+    OUT_FILES.with(|files| files.borrow_mut().remove(&path));
+    let text = args[1..].iter().map(file_text).collect::<Vec<_>>().join(" ");
+    match std::fs::write(&path, text) {
+        Ok(()) => Ok(Value::Nothing),
+        Err(err) => error!(span, "Couldn't write {}: {}", path, err),
+    }
+}
+
+/// `append_file(path, values...)`: append the values as one line, like
+/// `print` into the file. The handle stays open and buffered across calls,
+/// so appending in a loop streams with constant memory; buffered lines land
+/// when the buffer fills and at `flush_output` time.
+pub fn append_file(span: &Span, args: Vec<Value>) -> Result<Value> {
+    let path = match args.first() {
+        Some(Value::String(path)) if args.len() >= 2 => path.borrow().clone(),
+        _ => error!(span, "append_file() takes a string path and at least one value"),
+    };
+    OUT_FILES.with(|files| {
+        let mut files = files.borrow_mut();
+        let file = match files.entry(path.clone()) {
+            std::collections::hash_map::Entry::Occupied(entry) => entry.into_mut(),
+            std::collections::hash_map::Entry::Vacant(entry) => {
+                let file = match std::fs::OpenOptions::new().append(true).create(true).open(&path)
+                {
+                    Ok(file) => file,
+                    Err(err) => error!(span, "Couldn't open {}: {}", path, err),
+                };
+                entry.insert(std::io::BufWriter::with_capacity(IO_BUFFER_SIZE, file))
+            }
+        };
+        for (i, arg) in args[1..].iter().enumerate() {
+            if i != 0 {
+                let _ = file.write_all(b" ");
+            }
+            let _ = file.write_all(file_text(arg).as_bytes());
+        }
+        let _ = file.write_all(b"\n");
+        Ok(Value::Nothing)
+    })
+}
+
+/// Total order over comparable values for the sorting and searching
+/// builtins: integers and floats compare numerically (mixed is fine),
+/// strings compare with strings. Anything else is an error, reported at the
+/// builtin's call site.
+fn compare(left: &Value, right: &Value, span: &Span) -> Result<std::cmp::Ordering> {
+    use std::cmp::Ordering;
+    Ok(match (&left.materialize(), &right.materialize()) {
+        (Value::Integer(l), Value::Integer(r)) => l.cmp(r),
+        (Value::Integer(l), Value::Float(r)) => {
+            (*l as f64).partial_cmp(r).unwrap_or(Ordering::Equal)
+        }
+        (Value::Float(l), Value::Integer(r)) => {
+            l.partial_cmp(&(*r as f64)).unwrap_or(Ordering::Equal)
+        }
+        (Value::Float(l), Value::Float(r)) => l.partial_cmp(r).unwrap_or(Ordering::Equal),
+        (Value::String(l), Value::String(r)) => l.borrow().cmp(&r.borrow()),
+        (l, r) => error!(span, "Can't compare {:?} and {:?}", l, r),
+    })
+}
+
+/// Sort a slice with the native (pattern-defeating quicksort) unstable
+/// sort. `sort_unstable_by` can't early-return, so a comparison error is
+/// parked and reported once the sort unwinds.
+fn sort_values(values: &mut [Value], span: &Span) -> Result<()> {
+    let mut failed = None;
+    values.sort_unstable_by(|a, b| match compare(a, b, span) {
+        Ok(ord) => ord,
+        Err(err) => {
+            failed.get_or_insert(err);
+            std::cmp::Ordering::Equal
+        }
+    });
+    match failed {
+        Some(err) => Err(err),
+        None => Ok(()),
+    }
+}
+
+/// `sort(array)`: sort the array in place.
+pub fn sort(span: &Span, args: Vec<Value>) -> Result<Value> {
+    match &args[..] {
+        [Value::Array(array)] => sort_values(&mut array.borrow_mut(), span)?,
+        _ => error!(span, "sort() takes a single array"),
+    }
+    Ok(Value::Nothing)
+}
+
+/// `sorted_by(key_fn, array)`: a new array sorted by each element's key.
+/// The key function runs once per element (decorate, sort, undecorate), so
+/// the comparisons themselves never re-enter the interpreter.
+pub fn sorted_by(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "sorted_by() takes a key function and an array");
+    }
+    let func = args[0].clone();
+    let target = args[1].materialize();
+    let items: Vec<Value> = match &target {
+        Value::Array(array) => array.borrow().clone(),
+        other => error!(span, "sorted_by() expects an array, got {:?}", other),
+    };
+
+    let mut interp = Interpreter::new();
+    let mut keyed: Vec<(Value, Value)> = items
+        .into_iter()
+        .map(|item| Ok((interp.call_value(func.clone(), vec![item.clone()], span)?, item)))
+        .collect::<Result<_>>()?;
+
+    let mut failed = None;
+    keyed.sort_unstable_by(|(a, _), (b, _)| match compare(a, b, span) {
+        Ok(ord) => ord,
+        Err(err) => {
+            failed.get_or_insert(err);
+            std::cmp::Ordering::Equal
+        }
+    });
+    if let Some(err) = failed {
+        return Err(err);
+    }
+    Ok(Value::Array(make!(keyed.into_iter().map(|(_, item)| item).collect::<Vec<_>>())))
+}
+
+/// `binary_search(array, value)`: the index of `value` in a sorted array,
+/// or `nothing` if it isn't there.
+pub fn binary_search(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 2 {
+        error!(span, "binary_search() takes an array and a value");
+    }
+    let target = args[0].materialize();
+    let array = match &target {
+        Value::Array(array) => array.borrow(),
+        other => error!(span, "binary_search() expects an array, got {:?}", other),
+    };
+    let mut failed = None;
+    let found = array.binary_search_by(|item| match compare(item, &args[1], span) {
+        Ok(ord) => ord,
+        Err(err) => {
+            failed.get_or_insert(err);
+            std::cmp::Ordering::Equal
+        }
+    });
+    if let Some(err) = failed {
+        return Err(err);
+    }
+    Ok(match found {
+        Ok(index) => Value::Integer(index as i64),
+        Err(_) => Value::Nothing,
+    })
+}
+
+/// Smallest or largest of a slice. Homogeneous integer/float slices take a
+/// bare comparison loop with one tag check per element; everything else
+/// goes through `compare`.
+fn extremum(values: &[Value], largest: bool, name: &str, span: &Span) -> Result<Value> {
+    use std::cmp::Ordering;
+    if values.is_empty() {
+        error!(span, "{}() of an empty iterable", name);
+    }
+    if values.iter().all(|v| matches!(v, Value::Integer(_))) {
+        let nums = values.iter().filter_map(|v| match v {
+            Value::Integer(n) => Some(*n),
+            _ => None,
+        });
+        let best = if largest { nums.max() } else { nums.min() };
+        return Ok(Value::Integer(best.unwrap()));
+    }
+    if values.iter().all(|v| matches!(v, Value::Float(_))) {
+        let nums = values.iter().filter_map(|v| match v {
+            Value::Float(n) => Some(*n),
+            _ => None,
+        });
+        let best = if largest { nums.fold(f64::NEG_INFINITY, f64::max) } else { nums.fold(f64::INFINITY, f64::min) };
+        return Ok(Value::Float(best));
+    }
+    let mut best = values[0].clone();
+    for value in &values[1..] {
+        let ord = compare(value, &best, span)?;
+        if ord == if largest { Ordering::Greater } else { Ordering::Less } {
+            best = value.clone();
+        }
+    }
+    Ok(best)
+}
+
+/// The values behind a `min`/`max` call: the arguments themselves when
+/// there are several, otherwise the contents of the one iterable.
+fn extremum_args(args: Vec<Value>, name: &str, span: &Span) -> Result<Vec<Value>> {
+    if args.is_empty() {
+        error!(span, "{}() takes an iterable or several values", name);
+    }
+    if args.len() > 1 {
+        return Ok(args);
+    }
+    if let Value::Array(array) = &args[0].materialize() {
+        return Ok(array.borrow().clone());
+    }
+    let iter = iterate(&args[0], span)?;
+    let mut values = vec![];
+    loop {
+        match iter.0.borrow_mut().next() {
+            Some(item) => values.push(item?),
+            None => return Ok(values),
+        }
+    }
+}
+
+/// `min(iterable)` or `min(a, b, ...)`.
+pub fn min(span: &Span, args: Vec<Value>) -> Result<Value> {
+    extremum(&extremum_args(args, "min", span)?, false, "min", span)
+}
+
+/// `max(iterable)` or `max(a, b, ...)`.
+pub fn max(span: &Span, args: Vec<Value>) -> Result<Value> {
+    extremum(&extremum_args(args, "max", span)?, true, "max", span)
+}
+
+/// `copy(value)`: a deep copy, making the cost of defensive copying
+/// explicit. Plain assignment and argument passing share the array (O(1));
+/// scripts that want an independent buffer say so with `copy`.
+pub fn copy(span: &Span, args: Vec<Value>) -> Result<Value> {
+    if args.len() != 1 {
+        error!(span, "copy() takes exactly one argument");
+    }
+    Ok(args[0].deep_copy())
+}
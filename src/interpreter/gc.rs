@@ -0,0 +1,254 @@
+use crate::common::Ref;
+use crate::interpreter::value::{Function, Value};
+use crate::interpreter::Scope;
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::rc::{Rc, Weak};
+
+// A named function is inserted into the very scope it captures, so
+// `Function.scope -> Scope.vars[name] -> Function` is an unbreakable `Rc`
+// cycle and every such closure would leak its whole environment. This is a
+// trial-deletion cycle collector over the closure graph: it counts, for each
+// function/scope/container reachable from a tracked closure, how many of its
+// strong references come from inside that graph. Nodes with references the
+// graph can't account for are externally reachable and live; whatever the
+// live set can't reach is cyclic garbage, and its scopes and containers are
+// emptied so the `Rc`s unwind normally.
+
+/// Run a collection automatically once this many closures have been created
+/// since the last one, so long scripts get stable memory without the REPL's
+/// per-evaluation collections.
+const AUTO_COLLECT_THRESHOLD: usize = 10_000;
+
+thread_local! {
+    static TRACKED: RefCell<Vec<Weak<RefCell<Function>>>> = const { RefCell::new(Vec::new()) };
+    static SINCE_COLLECT: std::cell::Cell<usize> = const { std::cell::Cell::new(0) };
+}
+
+/// Register a newly created closure with the collector.
+pub(crate) fn track(func: &Ref<Function>) {
+    TRACKED.with(|tracked| tracked.borrow_mut().push(Rc::downgrade(func)));
+    let count = SINCE_COLLECT.with(|c| {
+        c.set(c.get() + 1);
+        c.get()
+    });
+    if count >= AUTO_COLLECT_THRESHOLD {
+        collect();
+    }
+}
+
+enum Node {
+    Function(Ref<Function>),
+    Scope(Ref<Scope>),
+    Array(Ref<Vec<Value>>),
+    Dict(Ref<crate::interpreter::value::Dict>),
+}
+
+impl Node {
+    fn id(&self) -> usize {
+        match self {
+            Node::Function(rc) => Rc::as_ptr(rc) as usize,
+            Node::Scope(rc) => Rc::as_ptr(rc) as usize,
+            Node::Array(rc) => Rc::as_ptr(rc) as usize,
+            Node::Dict(rc) => Rc::as_ptr(rc) as usize,
+        }
+    }
+
+    fn strong_count(&self) -> usize {
+        match self {
+            Node::Function(rc) => Rc::strong_count(rc),
+            Node::Scope(rc) => Rc::strong_count(rc),
+            Node::Array(rc) => Rc::strong_count(rc),
+            Node::Dict(rc) => Rc::strong_count(rc),
+        }
+    }
+}
+
+struct NodeInfo {
+    node: Node,
+    /// Strong references coming from other nodes in the scanned graph.
+    internal: usize,
+    /// Externally reachable no matter what the counts say (e.g. it holds an
+    /// iterator, whose closure we can't see into).
+    pinned: bool,
+    edges: Vec<usize>,
+}
+
+struct Graph {
+    nodes: HashMap<usize, NodeInfo>,
+    pending: Vec<usize>,
+}
+
+impl Graph {
+    /// Add the graph node behind a value, if any, and return its id.
+    fn value_edge(&mut self, value: &Value) -> Option<usize> {
+        match value {
+            Value::Function(func) => Some(self.intern(Node::Function(func.clone()))),
+            Value::Array(array) => Some(self.intern(Node::Array(array.clone()))),
+            Value::Dict(map) => Some(self.intern(Node::Dict(map.clone()))),
+            Value::Slice(slice) => match slice.try_borrow() {
+                Ok(slice) => self.value_edge(slice.base()),
+                Err(_) => None,
+            },
+            _ => None,
+        }
+    }
+
+    fn intern(&mut self, node: Node) -> usize {
+        let id = node.id();
+        if !self.nodes.contains_key(&id) {
+            self.nodes.insert(
+                id,
+                NodeInfo { node, internal: 0, pinned: false, edges: vec![] },
+            );
+            self.pending.push(id);
+        }
+        id
+    }
+
+    /// Enumerate the references one node holds into the rest of the graph.
+    /// Anything we can't inspect (a borrow held by running code, an opaque
+    /// iterator) pins the node as live instead.
+    fn scan(&mut self, id: usize) {
+        let node = match &self.nodes[&id].node {
+            Node::Function(rc) => Node::Function(rc.clone()),
+            Node::Scope(rc) => Node::Scope(rc.clone()),
+            Node::Array(rc) => Node::Array(rc.clone()),
+            Node::Dict(rc) => Node::Dict(rc.clone()),
+        };
+        let mut edges = vec![];
+        let mut pinned = false;
+        match &node {
+            Node::Function(func) => match func.try_borrow() {
+                Ok(func) => edges.push(self.intern(Node::Scope(func.scope.clone()))),
+                Err(_) => pinned = true,
+            },
+            Node::Scope(scope) => match scope.try_borrow() {
+                Ok(scope) => {
+                    if let Some(parent) = &scope.parent {
+                        edges.push(self.intern(Node::Scope(parent.clone())));
+                    }
+                    for value in scope.vars.values().chain(scope.slots.iter()) {
+                        if matches!(value, Value::Iterator(_)) {
+                            pinned = true;
+                        }
+                        if let Some(edge) = self.value_edge(value) {
+                            edges.push(edge);
+                        }
+                    }
+                }
+                Err(_) => pinned = true,
+            },
+            Node::Array(array) => match array.try_borrow() {
+                Ok(array) => {
+                    for value in array.iter() {
+                        if matches!(value, Value::Iterator(_)) {
+                            pinned = true;
+                        }
+                        if let Some(edge) = self.value_edge(value) {
+                            edges.push(edge);
+                        }
+                    }
+                }
+                Err(_) => pinned = true,
+            },
+            Node::Dict(map) => match map.try_borrow() {
+                Ok(map) => {
+                    for value in map.values() {
+                        if matches!(value, Value::Iterator(_)) {
+                            pinned = true;
+                        }
+                        if let Some(edge) = self.value_edge(value) {
+                            edges.push(edge);
+                        }
+                    }
+                }
+                Err(_) => pinned = true,
+            },
+        }
+        for edge in &edges {
+            self.nodes.get_mut(edge).unwrap().internal += 1;
+        }
+        let info = self.nodes.get_mut(&id).unwrap();
+        info.edges = edges;
+        info.pinned = info.pinned || pinned;
+    }
+}
+
+/// Trace the closure graph and break any cycles nothing outside it can
+/// reach. Returns how many scopes were torn down.
+pub fn collect() -> usize {
+    SINCE_COLLECT.with(|c| c.set(0));
+    let functions: Vec<Ref<Function>> = TRACKED.with(|tracked| {
+        let mut tracked = tracked.borrow_mut();
+        tracked.retain(|weak| weak.strong_count() > 0);
+        tracked.iter().filter_map(Weak::upgrade).collect()
+    });
+    if functions.is_empty() {
+        return 0;
+    }
+
+    let mut graph = Graph { nodes: HashMap::new(), pending: vec![] };
+    for func in &functions {
+        graph.intern(Node::Function(func.clone()));
+    }
+    while let Some(id) = graph.pending.pop() {
+        graph.scan(id);
+    }
+    // `functions` holds one extra strong reference per tracked closure.
+    for func in &functions {
+        let id = Rc::as_ptr(func) as usize;
+        graph.nodes.get_mut(&id).unwrap().internal += 1;
+    }
+    drop(functions);
+
+    // Mark: anything with references the graph can't account for is a root.
+    let mut live: Vec<usize> = graph
+        .nodes
+        .iter()
+        .filter(|(_, info)| {
+            // One strong count belongs to the `Node`'s own clone.
+            info.pinned || info.node.strong_count() - 1 > info.internal
+        })
+        .map(|(id, _)| *id)
+        .collect();
+    let mut marked: std::collections::HashSet<usize> = live.iter().copied().collect();
+    while let Some(id) = live.pop() {
+        for edge in graph.nodes[&id].edges.clone() {
+            if marked.insert(edge) {
+                live.push(edge);
+            }
+        }
+    }
+
+    // Sweep: empty the unmarked scopes and containers so their `Rc`s unwind.
+    let mut collected = 0;
+    for (id, info) in &graph.nodes {
+        if marked.contains(id) {
+            continue;
+        }
+        match &info.node {
+            Node::Scope(scope) => {
+                if let Ok(mut scope) = scope.try_borrow_mut() {
+                    scope.vars.clear();
+                    scope.slots.clear();
+                    scope.slot_names.clear();
+                    scope.parent = None;
+                    collected += 1;
+                }
+            }
+            Node::Array(array) => {
+                if let Ok(mut array) = array.try_borrow_mut() {
+                    array.clear();
+                }
+            }
+            Node::Dict(map) => {
+                if let Ok(mut map) = map.try_borrow_mut() {
+                    map.clear();
+                }
+            }
+            Node::Function(_) => {}
+        }
+    }
+    collected
+}
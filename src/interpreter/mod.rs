@@ -1,16 +1,26 @@
-use crate::ast::AST;
+use crate::ast::{Ast, NodeId, AST};
 use crate::common::{make, Ref, Span};
 use crate::error::{runtime_error as error, Result};
 use crate::interpreter::value::{IteratorValue, Value, Function};
+use crate::symbol::Symbol;
 use std::collections::HashMap;
 use std::rc::Rc;
 
 mod builtin;
+pub mod gc;
+pub(crate) mod par;
 pub mod value;
 
+pub use builtin::flush_output;
+
 #[derive(Debug)]
 pub struct Scope {
-    pub vars: HashMap<String, Value>,
+    pub vars: HashMap<Symbol, Value>,
+    /// Slot-indexed storage for resolved variables. `slot_names` maps each
+    /// slot-declared name to its index so the dynamic name-lookup path stays
+    /// consistent with slot-based access.
+    pub slots: Vec<Value>,
+    pub slot_names: HashMap<Symbol, u16>,
     pub parent: Option<Ref<Scope>>,
     pub in_function: bool,
 }
@@ -19,14 +29,19 @@ impl Scope {
     pub fn new(parent: Option<Ref<Scope>>, in_function: bool) -> Ref<Scope> {
         make!(Scope {
             vars: HashMap::new(),
+            slots: vec![],
+            slot_names: HashMap::new(),
             parent,
             in_function,
         })
     }
 
-    fn insert(&mut self, name: &str, value: Value, update: bool, loc: &Span) -> Result<()> {
-        if !update || self.vars.contains_key(name) {
-            self.vars.insert(name.to_string(), value);
+    pub(crate) fn insert(&mut self, name: Symbol, value: Value, update: bool, loc: &Span) -> Result<()> {
+        if let Some(slot) = self.slot_names.get(&name) {
+            let slot = *slot;
+            self.set_slot(slot, value);
+        } else if !update || self.vars.contains_key(&name) {
+            self.vars.insert(name, value);
         } else {
             match &self.parent {
                 Some(parent) => parent.borrow_mut().insert(name, value, update, loc)?,
@@ -36,9 +51,28 @@ impl Scope {
         Ok(())
     }
 
-    fn get(&self, name: &str) -> Option<Value> {
-        if self.vars.contains_key(name) {
-            self.vars.get(name).cloned()
+    pub(crate) fn insert_slot(&mut self, name: Symbol, value: Value, slot: u16) {
+        self.slot_names.insert(name, slot);
+        self.set_slot(slot, value);
+    }
+
+    fn set_slot(&mut self, slot: u16, value: Value) {
+        let slot = slot as usize;
+        if slot >= self.slots.len() {
+            self.slots.resize(slot + 1, Value::Nothing);
+        }
+        self.slots[slot] = value;
+    }
+
+    pub(crate) fn get_slot(&self, slot: u16) -> Option<Value> {
+        self.slots.get(slot as usize).cloned()
+    }
+
+    pub(crate) fn get(&self, name: Symbol) -> Option<Value> {
+        if let Some(slot) = self.slot_names.get(&name) {
+            self.get_slot(*slot)
+        } else if self.vars.contains_key(&name) {
+            self.vars.get(&name).cloned()
         } else {
             match &self.parent {
                 Some(parent) => parent.borrow_mut().get(name),
@@ -48,56 +82,115 @@ impl Scope {
     }
 }
 
+/// Walk `depth` parent links up the scope chain.
+fn scope_at(scope: &Ref<Scope>, depth: u16) -> Ref<Scope> {
+    let mut cur = scope.clone();
+    for _ in 0..depth {
+        let parent = cur
+            .borrow()
+            .parent
+            .clone()
+            .expect("resolved depth exceeds scope chain");
+        cur = parent;
+    }
+    cur
+}
+
 #[derive(Debug)]
 enum ControlFlow {
     None,
     Continue,
     Break,
     Return(Value),
+    /// `return f(...)`: the callee runs in the caller's native frame so tail
+    /// recursion doesn't grow the Rust stack.
+    TailCall(Ref<Function>, Vec<Value>),
 }
 
-type BuiltInFunctionType = fn(&Span, Vec<Value>) -> Result<Value>;
+/// Default cap on serpens call depth; see `Interpreter::set_recursion_limit`.
+const DEFAULT_RECURSION_LIMIT: usize = 1000;
+
+pub type BuiltInFunctionType = fn(&Span, Vec<Value>) -> Result<Value>;
+
+/// A built-in function, resolved once to a function pointer so calls don't
+/// hash the name on every invocation.
+#[derive(Debug)]
+pub struct BuiltIn {
+    pub name: &'static str,
+    pub func: BuiltInFunctionType,
+}
 
 pub struct Interpreter {
-    builtins: HashMap<&'static str, BuiltInFunctionType>,
+    builtins: HashMap<Symbol, &'static BuiltIn>,
     control_flow: ControlFlow,
+    depth: usize,
+    recursion_limit: usize,
+    /// Checked once at construction; keeps the dispatch hot path to a single
+    /// branch when `--profile` is off.
+    profiling: bool,
 }
 
 macro_rules! builtins {
-    ($($name:ident),+ $(,)?) => {
-        HashMap::from([$(
-            (
-                stringify!($name),
-                builtin::$name as BuiltInFunctionType,
-            ),
-        )+])
-    };
+    ($($name:ident),+ $(,)?) => {{
+        static BUILTINS: &[BuiltIn] = &[$(
+            BuiltIn {
+                name: stringify!($name),
+                func: builtin::$name,
+            },
+        )+];
+        BUILTINS.iter().map(|b| (b.name, b)).collect()
+    }};
+}
+
+/// The default set of built-in functions, shared by the tree-walking
+/// interpreter and the bytecode VM.
+pub(crate) fn default_builtins() -> HashMap<&'static str, &'static BuiltIn> {
+    builtins!(
+        print, write, len, exit, join, map, filter, zip, enumerate, take, sum, reduce, push, pop,
+        open, read_file, write_file, append_file, sort, sorted_by, binary_search, min, max, copy,
+    )
 }
 
 impl Interpreter {
     pub fn new() -> Self {
-        let builtins = builtins!(print, len, exit);
         Self {
-            builtins,
+            builtins: default_builtins()
+                .into_iter()
+                .map(|(name, builtin)| (Symbol::intern(name), builtin))
+                .collect(),
             control_flow: ControlFlow::None,
+            depth: 0,
+            recursion_limit: DEFAULT_RECURSION_LIMIT,
+            profiling: crate::profiler::enabled(),
         }
     }
 
-    pub fn execute(&mut self, ast: &Rc<AST>) -> Result<Value> {
+    /// Cap serpens call depth so runaway recursion raises a runtime error
+    /// instead of overflowing the native stack.
+    pub fn set_recursion_limit(&mut self, limit: usize) {
+        self.recursion_limit = limit;
+    }
+
+    pub fn execute(&mut self, ast: &Rc<Ast>) -> Result<Value> {
         let scope = Scope::new(None, false);
-        self.run(ast, scope)
+        self.run(ast, ast.root(), scope)
     }
 
     pub fn run_block_without_new_scope(
         &mut self,
-        ast: &Rc<AST>,
+        ast: &Rc<Ast>,
+        node: NodeId,
         scope: Ref<Scope>,
     ) -> Result<Value> {
-        match ast.as_ref() {
-            AST::Block(_, stmts) => {
+        match &ast[node] {
+            AST::Block(_, stmts, _) => {
                 let mut last = None;
                 for stmt in stmts {
-                    last = Some(self.run(stmt, scope.clone())?);
+                    last = Some(self.run(ast, *stmt, scope.clone())?);
+                    // Stop executing the block on break/continue/return.
+                    if !matches!(self.control_flow, ControlFlow::None) {
+                        break;
+                    }
                 }
                 Ok(last.unwrap_or_else(|| Value::Nothing))
             }
@@ -105,20 +198,38 @@ impl Interpreter {
         }
     }
 
-    fn run(&mut self, ast: &Rc<AST>, scope: Ref<Scope>) -> Result<Value> {
+    fn run(&mut self, ast: &Rc<Ast>, node: NodeId, scope: Ref<Scope>) -> Result<Value> {
+        if self.profiling {
+            crate::profiler::tick(ast[node].span());
+        }
         macro_rules! dispatch_op {
             ($span:expr, $op:path, $left:expr, $right:expr) => {{
-                let left = self.run($left, scope.clone())?;
-                let right = self.run($right, scope.clone())?;
+                let left = self.run(ast, *$left, scope.clone())?;
+                let right = self.run(ast, *$right, scope.clone())?;
                 $op(&left, &right, $span)?
             }};
 
             ($span:expr, $op:path, $val:expr) => {{
-                let val = self.run($val, scope.clone())?;
+                let val = self.run(ast, *$val, scope.clone())?;
                 $op(&val, $span)?
             }};
         }
-        Ok(match ast.as_ref() {
+        // Like `dispatch_op`, but with a monomorphic integer fast path: two
+        // tag checks and the unboxed operation, instead of the full
+        // `(left, right)` cross-product match inside the `Value` method.
+        // Numeric inner loops are overwhelmingly `i64 op i64`.
+        macro_rules! dispatch_num_op {
+            ($span:expr, $op:path, $fast:expr, $left:expr, $right:expr) => {{
+                let left = self.run(ast, *$left, scope.clone())?;
+                let right = self.run(ast, *$right, scope.clone())?;
+                if let (Value::Integer(l), Value::Integer(r)) = (&left, &right) {
+                    $fast(*l, *r)
+                } else {
+                    $op(&left, &right, $span)?
+                }
+            }};
+        }
+        Ok(match &ast[node] {
             // Literals
             AST::BooleanLiteral(_, value) => Value::Boolean(*value),
             AST::IntegerLiteral(_, num) => Value::Integer(*num),
@@ -126,49 +237,70 @@ impl Interpreter {
             AST::StringLiteral(_, string) => Value::String(make!(string.clone())),
             AST::Nothing(_) => Value::Nothing,
 
-            AST::Plus(span, left, right) => dispatch_op!(span, Value::plus, left, right),
-            AST::Minus(span, left, right) => dispatch_op!(span, Value::minus, left, right),
-            AST::Multiply(loc, left, right) => dispatch_op!(loc, Value::multiply, left, right),
-            AST::Divide(loc, left, right) => dispatch_op!(loc, Value::divide, left, right),
+            AST::Plus(span, left, right) => {
+                dispatch_num_op!(span, Value::plus, |l, r| Value::Integer(l + r), left, right)
+            }
+            AST::Minus(span, left, right) => {
+                dispatch_num_op!(span, Value::minus, |l, r| Value::Integer(l - r), left, right)
+            }
+            AST::Multiply(loc, left, right) => {
+                dispatch_num_op!(loc, Value::multiply, |l, r| Value::Integer(l * r), left, right)
+            }
+            AST::Divide(loc, left, right) => {
+                dispatch_num_op!(loc, Value::divide, |l, r| Value::Integer(l / r), left, right)
+            }
 
             AST::Not(loc, expr) => dispatch_op!(loc, Value::not, expr),
             AST::And(loc, left, right) => dispatch_op!(loc, Value::and, left, right),
             AST::Or(loc, left, right) => dispatch_op!(loc, Value::or, left, right),
 
-            AST::Equals(loc, left, right) => dispatch_op!(loc, Value::equals, left, right),
-            AST::NotEquals(loc, left, right) => dispatch_op!(loc, Value::not_equals, left, right),
-            AST::LessThan(loc, left, right) => dispatch_op!(loc, Value::less_than, left, right),
+            AST::Equals(loc, left, right) => {
+                dispatch_num_op!(loc, Value::equals, |l, r| Value::Boolean(l == r), left, right)
+            }
+            AST::NotEquals(loc, left, right) => {
+                dispatch_num_op!(loc, Value::not_equals, |l, r| Value::Boolean(l != r), left, right)
+            }
+            AST::LessThan(loc, left, right) => {
+                dispatch_num_op!(loc, Value::less_than, |l, r| Value::Boolean(l < r), left, right)
+            }
 
             AST::GreaterThan(loc, left, right) => {
-                dispatch_op!(loc, Value::greater_than, left, right)
+                dispatch_num_op!(loc, Value::greater_than, |l, r| Value::Boolean(l > r), left, right)
             }
             AST::LessEquals(loc, left, right) => {
-                dispatch_op!(loc, Value::less_equals, left, right)
+                dispatch_num_op!(loc, Value::less_equals, |l, r| Value::Boolean(l <= r), left, right)
             }
             AST::GreaterEquals(loc, left, right) => {
-                dispatch_op!(loc, Value::greater_equals, left, right)
+                dispatch_num_op!(loc, Value::greater_equals, |l, r| Value::Boolean(l >= r), left, right)
             }
 
-            AST::Call(span, func, args) => self.handle_call(scope, span, func, args)?,
+            AST::Call(span, func, args) => self.handle_call(ast, scope, span, *func, args)?,
 
             AST::Function {
                 name,
                 args,
                 body,
                 span,
-                ..
+                slot,
             } => {
-                let func = Value::Function(make!(Function {
+                let func_ref = make!(Function {
                     span: *span,
-                    name: name.clone().unwrap_or_else(|| "<anon>".to_string()),
+                    name: name.map_or_else(|| "<anon>".to_string(), |name| name.to_string()),
                     args: args.clone(),
-                    body: body.clone(),
+                    ast: ast.clone(),
+                    body: *body,
                     scope: scope.clone(),
-                }));
+                    chunk: None,
+                });
+                gc::track(&func_ref);
+                let func = Value::Function(func_ref);
                 match name {
-                    Some(name) => scope
-                        .borrow_mut()
-                        .insert(name, func.clone(), false, span)?,
+                    Some(name) => match slot.get() {
+                        Some(idx) => scope.borrow_mut().insert_slot(*name, func.clone(), idx),
+                        None => scope
+                            .borrow_mut()
+                            .insert(*name, func.clone(), false, span)?,
+                    },
                     None => {}
                 }
                 func
@@ -181,31 +313,37 @@ impl Interpreter {
                 end,
                 step,
             } => {
-                let lhs = self.run(lhs, scope.clone())?;
+                let lhs = self.run(ast, *lhs, scope.clone())?;
                 let start = start
-                    .clone()
-                    .map(|start| self.run(&start, scope.clone()))
+                    .map(|start| self.run(ast, start, scope.clone()))
                     .transpose()?;
                 let end = end
-                    .clone()
-                    .map(|end| self.run(&end, scope.clone()))
+                    .map(|end| self.run(ast, end, scope.clone()))
                     .transpose()?;
                 let step = step
-                    .clone()
-                    .map(|step| self.run(&step, scope.clone()))
+                    .map(|step| self.run(ast, step, scope.clone()))
                     .transpose()?;
                 lhs.slice(start, end, step, span)?
             }
 
-            AST::Block(..) => {
-                let block_scope = Scope::new(Some(scope.clone()), scope.borrow().in_function);
-                self.run_block_without_new_scope(ast, block_scope)?
+            AST::Block(_, _, needs_scope) => {
+                if needs_scope.get() {
+                    let block_scope = Scope::new(Some(scope.clone()), scope.borrow().in_function);
+                    self.run_block_without_new_scope(ast, node, block_scope)?
+                } else {
+                    self.run_block_without_new_scope(ast, node, scope)?
+                }
             }
 
-            AST::Variable(span, name) => {
-                if self.builtins.get(name.as_str()).is_some() {
-                    Value::BuiltInFunction(make!(name.clone()))
-                } else if let Some(value) = scope.borrow_mut().get(name) {
+            AST::Variable(span, name, slot) => {
+                if let Some((depth, idx)) = slot.get() {
+                    match scope_at(&scope, depth).borrow().get_slot(idx) {
+                        Some(value) => value,
+                        None => error!(span, "Variable {} not found", name),
+                    }
+                } else if let Some(builtin) = self.builtins.get(name) {
+                    Value::BuiltInFunction(builtin)
+                } else if let Some(value) = scope.borrow_mut().get(*name) {
                     value
                 } else {
                     error!(span, "Variable {} not found", name)
@@ -216,32 +354,102 @@ impl Interpreter {
                 if !scope.borrow_mut().in_function {
                     error!(span, "Return statement outside of function")
                 }
-                self.control_flow = ControlFlow::Return(self.run(val, scope)?);
+                match &ast[*val] {
+                    // Tail call: hand the callee back to the active
+                    // `call_value` loop instead of recursing into it here.
+                    AST::Call(_, func, call_args) => {
+                        let callee = self.run(ast, *func, scope.clone())?;
+                        let args = call_args
+                            .iter()
+                            .map(|arg| self.run(ast, *arg, scope.clone()))
+                            .collect::<Result<Vec<_>>>()?;
+                        match callee {
+                            Value::Function(callee) => {
+                                self.control_flow = ControlFlow::TailCall(callee, args)
+                            }
+                            other => {
+                                let value = self.call_value(other, args, span)?;
+                                self.control_flow = ControlFlow::Return(value)
+                            }
+                        }
+                    }
+                    _ => self.control_flow = ControlFlow::Return(self.run(ast, *val, scope)?),
+                }
                 Value::Nothing
             }
 
             AST::Assignment(span, lhs, value) => {
-                let value = self.run(value, scope.clone())?;
-                self.handle_assign(scope, span, lhs, value.clone())?;
+                // `s = s + expr` on strings appends in place when `s` is
+                // unaliased, so building a string in a loop is O(n) overall
+                // instead of copying the accumulator on every iteration.
+                if let AST::Plus(_, plus_lhs, plus_rhs) = &ast[*value] {
+                    if let (AST::Variable(_, target, _), AST::Variable(_, source, _)) =
+                        (&ast[*lhs], &ast[*plus_lhs])
+                    {
+                        if target == source {
+                            let target = *target;
+                            let cur = scope.borrow().get(target);
+                            if let Some(cur) = cur {
+                                let addend = self.run(ast, *plus_rhs, scope.clone())?;
+                                let value =
+                                    Value::append(cur, &addend, span, || {
+                                        scope.borrow_mut().insert(target, Value::Nothing, true, span)
+                                    })?;
+                                self.handle_assign(ast, scope, span, *lhs, value.clone())?;
+                                return Ok(value);
+                            }
+                        }
+                    }
+                }
+                // `arr[i] op= rhs` shares the target node between both sides
+                // of the desugared assignment; evaluate the container and
+                // index once and write back through them.
+                if let AST::Index(..) = &ast[*lhs] {
+                    type BinFn = fn(&Value, &Value, &Span) -> Result<Value>;
+                    let rmw: Option<(BinFn, NodeId)> = match &ast[*value] {
+                        AST::Plus(_, l, r) if l == lhs => Some((Value::plus, *r)),
+                        AST::Minus(_, l, r) if l == lhs => Some((Value::minus, *r)),
+                        AST::Multiply(_, l, r) if l == lhs => Some((Value::multiply, *r)),
+                        AST::Divide(_, l, r) if l == lhs => Some((Value::divide, *r)),
+                        _ => None,
+                    };
+                    if let (Some((apply, rhs)), AST::Index(_, container, index)) =
+                        (rmw, &ast[*lhs])
+                    {
+                        let (container, index) = (*container, *index);
+                        let target = self.run(ast, container, scope.clone())?;
+                        let idx = self.run(ast, index, scope.clone())?;
+                        let old = target.index(&idx, span)?;
+                        let addend = self.run(ast, rhs, scope)?;
+                        let value = apply(&old, &addend, span)?;
+                        target.set_index(&idx, value.clone(), span)?;
+                        return Ok(value);
+                    }
+                }
+                let value = self.run(ast, *value, scope.clone())?;
+                self.handle_assign(ast, scope, span, *lhs, value.clone())?;
                 value
             }
 
-            AST::VarDeclaration(span, name, value) => {
-                if self.builtins.contains_key(name.as_str()) {
+            AST::VarDeclaration(span, name, value, slot) => {
+                if self.builtins.contains_key(name) {
                     error!(
                         span,
                         "`{}` is a built-in function, can't be used as a variable", name
                     )
                 }
-                let value = self.run(value, scope.clone())?;
-                scope
-                    .borrow_mut()
-                    .insert(name, value.clone(), false, span)?;
+                let value = self.run(ast, *value, scope.clone())?;
+                match slot.get() {
+                    Some(idx) => scope.borrow_mut().insert_slot(*name, value.clone(), idx),
+                    None => scope
+                        .borrow_mut()
+                        .insert(*name, value.clone(), false, span)?,
+                }
                 value
             }
 
             AST::Assert(loc, cond) => {
-                let cond = self.run(cond, scope)?;
+                let cond = self.run(ast, *cond, scope)?;
                 match cond {
                     Value::Boolean(true) => {}
                     Value::Boolean(false) => error!(loc, "Assertion failed"),
@@ -251,11 +459,11 @@ impl Interpreter {
             }
 
             AST::If(span, cond, body, else_body) => {
-                let cond = self.run(cond, scope.clone())?;
+                let cond = self.run(ast, *cond, scope.clone())?;
                 match cond {
-                    Value::Boolean(true) => self.run(body, scope)?,
+                    Value::Boolean(true) => self.run(ast, *body, scope)?,
                     Value::Boolean(false) => match else_body {
-                        Some(else_body) => self.run(else_body, scope)?,
+                        Some(else_body) => self.run(ast, *else_body, scope)?,
                         None => Value::Nothing,
                     },
                     _ => error!(span, "If condition must be a boolean"),
@@ -264,10 +472,10 @@ impl Interpreter {
 
             AST::While(span, cond, body) => {
                 loop {
-                    let cond = self.run(cond, scope.clone())?;
+                    let cond = self.run(ast, *cond, scope.clone())?;
                     match cond {
                         Value::Boolean(true) => {
-                            self.run(body, scope.clone())?;
+                            self.run(ast, *body, scope.clone())?;
                             match self.control_flow {
                                 ControlFlow::None => {}
                                 ControlFlow::Continue => self.control_flow = ControlFlow::None,
@@ -275,7 +483,7 @@ impl Interpreter {
                                     self.control_flow = ControlFlow::None;
                                     break;
                                 }
-                                ControlFlow::Return(_) => break,
+                                ControlFlow::Return(_) | ControlFlow::TailCall(..) => break,
                             }
                         }
                         Value::Boolean(false) => break,
@@ -285,19 +493,69 @@ impl Interpreter {
                 Value::Nothing
             }
 
-            AST::ForEach(span, loop_var, iter, body) => {
-                let val = self.run(iter, scope.clone())?;
+            AST::ForEach(span, loop_var, iter, body, slot) => {
+                let val = self.run(ast, *iter, scope.clone())?;
+                // Counted fast path: an integer range drives the loop off a
+                // raw i64 induction variable — no boxed iterator, no RefCell
+                // borrow per step, and the loop variable is written straight
+                // into its already-bound slot.
+                if let Value::Range(range) = &val {
+                    let loop_scope =
+                        Scope::new(Some(scope.clone()), scope.borrow_mut().in_function);
+                    let slot = slot.get();
+                    if let Some(idx) = slot {
+                        loop_scope
+                            .borrow_mut()
+                            .insert_slot(*loop_var, Value::Nothing, idx);
+                    }
+                    for i in range.start..range.end {
+                        match slot {
+                            Some(idx) => {
+                                loop_scope.borrow_mut().slots[idx as usize] = Value::Integer(i)
+                            }
+                            None => loop_scope.borrow_mut().insert(
+                                *loop_var,
+                                Value::Integer(i),
+                                false,
+                                span,
+                            )?,
+                        }
+                        self.run(ast, *body, loop_scope.clone())?;
+                        match self.control_flow {
+                            ControlFlow::None => {}
+                            ControlFlow::Continue => self.control_flow = ControlFlow::None,
+                            ControlFlow::Break => {
+                                self.control_flow = ControlFlow::None;
+                                break;
+                            }
+                            ControlFlow::Return(_) | ControlFlow::TailCall(..) => break,
+                        }
+                    }
+                    return Ok(Value::Nothing);
+                }
                 let iter = val.iterator(span)?;
                 match iter {
                     Value::Iterator(IteratorValue(iter)) => {
-                        let iter = &mut *(*iter).borrow_mut();
-                        for val in iter {
-                            let loop_scope =
-                                Scope::new(Some(scope.clone()), scope.borrow_mut().in_function);
-                            loop_scope
-                                .borrow_mut()
-                                .insert(loop_var, val.clone(), false, span)?;
-                            self.run(body, loop_scope)?;
+                        // One scope for the whole loop; the loop variable is
+                        // rebound in place each iteration.
+                        let loop_scope =
+                            Scope::new(Some(scope.clone()), scope.borrow_mut().in_function);
+                        // Borrow per step, not across the body: iterators
+                        // are first-class values, so the body may pull from
+                        // (or nest a loop over) this same cursor.
+                        loop {
+                            let next = iter.borrow_mut().next();
+                            let Some(val) = next else { break };
+                            let val = val?;
+                            match slot.get() {
+                                Some(idx) => loop_scope
+                                    .borrow_mut()
+                                    .insert_slot(*loop_var, val.clone(), idx),
+                                None => loop_scope
+                                    .borrow_mut()
+                                    .insert(*loop_var, val.clone(), false, span)?,
+                            }
+                            self.run(ast, *body, loop_scope.clone())?;
                             match self.control_flow {
                                 ControlFlow::None => {}
                                 ControlFlow::Continue => self.control_flow = ControlFlow::None,
@@ -305,7 +563,7 @@ impl Interpreter {
                                     self.control_flow = ControlFlow::None;
                                     break;
                                 }
-                                ControlFlow::Return(_) => break,
+                                ControlFlow::Return(_) | ControlFlow::TailCall(..) => break,
                             }
                         }
                     }
@@ -323,18 +581,18 @@ impl Interpreter {
             } => {
                 let loop_scope = Scope::new(Some(scope.clone()), scope.borrow().in_function);
                 if let Some(init) = init {
-                    self.run(init, loop_scope.clone())?;
+                    self.run(ast, *init, loop_scope.clone())?;
                 }
                 loop {
                     if let Some(cond) = cond {
-                        let cond = self.run(cond, loop_scope.clone())?;
+                        let cond = self.run(ast, *cond, loop_scope.clone())?;
                         match cond {
                             Value::Boolean(true) => {}
                             Value::Boolean(false) => break,
                             _ => error!(span, "For condition must be a boolean"),
                         };
                     }
-                    self.run(body, loop_scope.clone())?;
+                    self.run(ast, *body, loop_scope.clone())?;
                     match self.control_flow {
                         ControlFlow::None => {}
                         ControlFlow::Continue => self.control_flow = ControlFlow::None,
@@ -342,18 +600,18 @@ impl Interpreter {
                             self.control_flow = ControlFlow::None;
                             break;
                         }
-                        ControlFlow::Return(_) => break,
+                        ControlFlow::Return(_) | ControlFlow::TailCall(..) => break,
                     }
                     if let Some(step) = step {
-                        self.run(step, loop_scope.clone())?;
+                        self.run(ast, *step, loop_scope.clone())?;
                     }
                 }
                 Value::Nothing
             }
 
             AST::Range(span, start, end) => {
-                let start = self.run(start, scope.clone())?;
-                let end = self.run(end, scope)?;
+                let start = self.run(ast, *start, scope.clone())?;
+                let end = self.run(ast, *end, scope)?;
                 Value::create_range(&start, &end, span)?
             }
 
@@ -367,62 +625,132 @@ impl Interpreter {
             }
 
             AST::Index(span, left, right) => {
-                let left = self.run(left, scope.clone())?;
-                let right = self.run(right, scope)?;
+                let left = self.run(ast, *left, scope.clone())?;
+                let right = self.run(ast, *right, scope)?;
                 left.index(&right, span)?
             },
 
-            AST::PostIncrement(span, expr, offset) => {
-                let value = self.run(expr, scope.clone())?;
-                match &value {
-                    Value::Integer(val) => {
-                        let new_val = Value::Integer(*val + offset);
-                        self.handle_assign(scope, span, expr, new_val)?;
+            AST::ParForEach(span, var, iterable, body) => {
+                let items = self.run(ast, *iterable, scope)?;
+                par::run_par_for(ast, *body, *var, items, span)?
+            }
+
+            AST::Import(span, path) => {
+                let bindings = crate::module::import(span.0.filename, path, span)?;
+                let mut scope = scope.borrow_mut();
+                for (name, value) in bindings {
+                    scope.insert(name, value, false, span)?;
+                }
+                Value::Nothing
+            }
+
+            // `arr[i]++` evaluates the container and index once, rather than
+            // once for the read and again through `handle_assign`. Variable
+            // targets still go through `handle_assign`, which is just a slot
+            // lookup.
+            AST::PostIncrement(span, expr, offset) => match &ast[*expr] {
+                AST::Index(_, left, right) => {
+                    let target = self.run(ast, *left, scope.clone())?;
+                    let index = self.run(ast, *right, scope)?;
+                    let old = target.index(&index, span)?;
+                    match &old {
+                        Value::Integer(val) => {
+                            target.set_index(&index, Value::Integer(*val + offset), span)?;
+                        }
+                        _ => error!(span, "Operation only supported for integers"),
                     }
-                    _ => error!(span, "Operation only supported for integers"),
+                    old
+                }
+                _ => {
+                    let value = self.run(ast, *expr, scope.clone())?;
+                    match &value {
+                        Value::Integer(val) => {
+                            let new_val = Value::Integer(*val + offset);
+                            self.handle_assign(ast, scope, span, *expr, new_val)?;
+                        }
+                        _ => error!(span, "Operation only supported for integers"),
+                    }
+                    value
                 }
-                value
             },
-            AST::PreIncrement(span, expr, offset) => {
-                let value = self.run(expr, scope.clone())?;
-                match &value {
-                    Value::Integer(val) => {
-                        let new_val = Value::Integer(*val + offset);
-                        self.handle_assign(scope, span, expr, new_val.clone())?;
-                        new_val
+            AST::PreIncrement(span, expr, offset) => match &ast[*expr] {
+                AST::Index(_, left, right) => {
+                    let target = self.run(ast, *left, scope.clone())?;
+                    let index = self.run(ast, *right, scope)?;
+                    let old = target.index(&index, span)?;
+                    match &old {
+                        Value::Integer(val) => {
+                            let new_val = Value::Integer(*val + offset);
+                            target.set_index(&index, new_val.clone(), span)?;
+                            new_val
+                        }
+                        _ => error!(span, "Operation only supported for integers"),
+                    }
+                }
+                _ => {
+                    let value = self.run(ast, *expr, scope.clone())?;
+                    match &value {
+                        Value::Integer(val) => {
+                            let new_val = Value::Integer(*val + offset);
+                            self.handle_assign(ast, scope, span, *expr, new_val.clone())?;
+                            new_val
+                        }
+                        _ => error!(span, "Operation only supported for integers"),
                     }
-                    _ => error!(span, "Operation only supported for integers"),
                 }
             },
 
             AST::ArrayLiteral(_, arr) => {
                 Value::Array(make!(
                     arr.iter()
-                        .map(|x| self.run(x, scope.clone()))
+                        .map(|x| self.run(ast, *x, scope.clone()))
                         .collect::<Result<Vec<_>>>()?
                 ))
             }
+            AST::DictLiteral(span, pairs) => {
+                let mut map = crate::interpreter::value::Dict::default();
+                for (key, value) in pairs {
+                    let key = self.run(ast, *key, scope.clone())?.dict_key(span)?;
+                    let value = self.run(ast, *value, scope.clone())?;
+                    map.insert(key, value);
+                }
+                Value::Dict(make!(map))
+            }
         })
     }
 
     fn handle_assign(
         &mut self,
+        ast: &Rc<Ast>,
         scope: Ref<Scope>,
         span: &Span,
-        left: &Rc<AST>,
+        left: NodeId,
         value: Value,
     ) -> Result<()> {
-        match &**left {
-            AST::Variable(span, name) => {
-                if scope.borrow_mut().get(name.as_str()).is_none() {
+        match &ast[left] {
+            AST::Variable(span, name, slot) => {
+                if let Some((depth, idx)) = slot.get() {
+                    let target = scope_at(&scope, depth);
+                    if target.borrow().get_slot(idx).is_none() {
+                        error!(span, "Variable {} doesn't exist", name)
+                    }
+                    target.borrow_mut().insert_slot(*name, value, idx);
+                    return Ok(());
+                }
+                if scope.borrow_mut().get(*name).is_none() {
                     error!(span, "Variable {} doesn't exist", name)
                 }
-                if self.builtins.contains_key(name.as_str()) {
+                if self.builtins.contains_key(name) {
                     error!(span, "`{}` is a built-in function, can't override it", name)
                 }
                 scope
                     .borrow_mut()
-                    .insert(name.as_str(), value, true, span)?;
+                    .insert(*name, value, true, span)?;
+            }
+            AST::Index(_, lhs, index) => {
+                let target = self.run(ast, *lhs, scope.clone())?;
+                let index = self.run(ast, *index, scope)?;
+                target.set_index(&index, value, span)?;
             }
             _ => error!(span, "Invalid assignment target"),
         }
@@ -431,46 +759,80 @@ impl Interpreter {
 
     fn handle_call(
         &mut self,
+        ast: &Rc<Ast>,
         scope: Ref<Scope>,
         span: &Span,
-        func: &Rc<AST>,
-        args: &[Rc<AST>],
+        func: NodeId,
+        args: &[NodeId],
     ) -> Result<Value> {
-        let func = self.run(func, scope.clone())?;
+        let func = self.run(ast, func, scope.clone())?;
         let args = args
             .iter()
-            .map(|arg| self.run(arg, scope.clone()))
+            .map(|arg| self.run(ast, *arg, scope.clone()))
             .collect::<Result<Vec<_>>>()?;
+        self.call_value(func, args, span)
+    }
 
-        return Ok(match func {
-            Value::Function(func) => {
-                let new_scope = Scope::new(Some(func.borrow().scope.clone()), true);
-                if args.len() != func.borrow().args.len() {
-                    error!(
-                        *span,
-                        "Expected {} arguments, got {}",
-                        func.borrow().args.len(),
-                        args.len()
-                    )
+    fn call_value(&mut self, func: Value, mut args: Vec<Value>, span: &Span) -> Result<Value> {
+        let mut func = match func {
+            Value::Function(func) => func,
+            Value::BuiltInFunction(builtin) => return (builtin.func)(span, args),
+            x => error!(span, "Can't call object {:?}", x),
+        };
+
+        if self.depth >= self.recursion_limit {
+            error!(
+                span,
+                "Maximum recursion depth ({}) exceeded", self.recursion_limit
+            )
+        }
+        self.depth += 1;
+        // Loops as long as each body ends in a tail call, so mutually
+        // recursive `return f(...)` chains run in this one native frame.
+        let result = loop {
+            let new_scope = {
+                let func = func.borrow();
+                if args.len() != func.args.len() {
+                    break Err(crate::error::Error {
+                        kind: crate::error::ErrorKind::Runtime,
+                        span: *span,
+                        message: format!(
+                            "Expected {} arguments, got {}",
+                            func.args.len(),
+                            args.len()
+                        ),
+                    });
                 }
-                for (arg, value) in func.borrow().args.iter().zip(args) {
-                    new_scope.borrow_mut().insert(arg, value, false, span)?;
+                let new_scope = Scope::new(Some(func.scope.clone()), true);
+                for (i, (arg, value)) in func.args.iter().zip(args.drain(..)).enumerate() {
+                    new_scope.borrow_mut().insert_slot(*arg, value, i as u16);
                 }
-                let body = func.borrow().body.clone();
-                self.run(&body, new_scope)?;
-                let value = if let ControlFlow::Return(value) = &self.control_flow {
-                    value.clone()
-                } else {
-                    Value::Nothing
-                };
-                self.control_flow = ControlFlow::None;
-                value
+                new_scope
+            };
+            let (body_ast, body) = {
+                let func = func.borrow();
+                (func.ast.clone(), func.body)
+            };
+            if self.profiling {
+                crate::profiler::enter_function(func.borrow().name.clone());
             }
-            Value::BuiltInFunction(func) => match self.builtins.get(func.borrow().as_str()) {
-                Some(func) => func(span, args)?,
-                None => error!(span, "Built-in function {} not found", func.borrow()),
-            },
-            x => error!(span, "Can't call object {:?}", x),
-        });
+            let run_result = self.run(&body_ast, body, new_scope);
+            if self.profiling {
+                crate::profiler::leave_function();
+            }
+            if let Err(err) = run_result {
+                break Err(err);
+            }
+            match std::mem::replace(&mut self.control_flow, ControlFlow::None) {
+                ControlFlow::Return(value) => break Ok(value),
+                ControlFlow::TailCall(next, next_args) => {
+                    func = next;
+                    args = next_args;
+                }
+                _ => break Ok(Value::Nothing),
+            }
+        };
+        self.depth -= 1;
+        result
     }
 }
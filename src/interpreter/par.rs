@@ -0,0 +1,175 @@
+use crate::ast::{Ast, NodeId};
+use crate::common::{make, Span};
+use crate::error::{runtime_error as error, Result};
+use crate::interpreter::value::{Dict, DictKey, RangeValue, Value};
+use crate::interpreter::{ControlFlow, Interpreter, Scope};
+use crate::symbol::Symbol;
+use std::rc::Rc;
+
+/// A deep, thread-sendable copy of a value. `Value` itself can't cross a
+/// thread boundary (`Ref<T>` is `Rc<RefCell<T>>`), so `par for` converts
+/// loop items on the way in and body results on the way out; only plain
+/// data makes the trip.
+enum PlainValue {
+    Integer(i64),
+    Float(f64),
+    Boolean(bool),
+    String(String),
+    Range(i64, i64),
+    Array(Vec<PlainValue>),
+    Dict(Vec<(DictKey, PlainValue)>),
+    Nothing,
+}
+
+impl PlainValue {
+    fn from_value(value: &Value, span: &Span) -> Result<PlainValue> {
+        Ok(match &value.materialize() {
+            Value::Integer(num) => PlainValue::Integer(*num),
+            Value::Float(num) => PlainValue::Float(*num),
+            Value::Boolean(flag) => PlainValue::Boolean(*flag),
+            Value::String(string) => PlainValue::String(string.borrow().clone()),
+            Value::Range(range) => PlainValue::Range(range.start, range.end),
+            Value::Array(array) => PlainValue::Array(
+                array
+                    .borrow()
+                    .iter()
+                    .map(|item| PlainValue::from_value(item, span))
+                    .collect::<Result<_>>()?,
+            ),
+            Value::Dict(map) => PlainValue::Dict(
+                map.borrow()
+                    .iter()
+                    .map(|(key, item)| Ok((key.clone(), PlainValue::from_value(item, span)?)))
+                    .collect::<Result<_>>()?,
+            ),
+            Value::Nothing => PlainValue::Nothing,
+            other => error!(span, "Can't send {:?} across par for threads", other),
+        })
+    }
+
+    fn into_value(self) -> Value {
+        match self {
+            PlainValue::Integer(num) => Value::Integer(num),
+            PlainValue::Float(num) => Value::Float(num),
+            PlainValue::Boolean(flag) => Value::Boolean(flag),
+            PlainValue::String(string) => Value::String(make!(string)),
+            PlainValue::Range(start, end) => Value::Range(Rc::new(RangeValue { start, end })),
+            PlainValue::Array(items) => Value::Array(make!(items
+                .into_iter()
+                .map(PlainValue::into_value)
+                .collect::<Vec<_>>())),
+            PlainValue::Dict(pairs) => {
+                let mut map = Dict::default();
+                for (key, item) in pairs {
+                    map.insert(key, item.into_value());
+                }
+                Value::Dict(make!(map))
+            }
+            PlainValue::Nothing => Value::Nothing,
+        }
+    }
+}
+
+/// Native stack for worker threads; bodies can recurse like any other code.
+const WORKER_STACK_SIZE: usize = 64 * 1024 * 1024;
+
+/// Run a `par for` body over every item of `iterable` across a worker pool,
+/// returning the array of per-iteration results in iteration order.
+///
+/// `Rc`, `Symbol` and the scope chain are all thread-local, so nothing of the
+/// live program crosses the boundary. Instead each worker decodes its own
+/// copy of the arena from the cache encoding (which stores symbols by name)
+/// and runs the body on a fresh tree-walking interpreter with only the loop
+/// variable in scope — the body must be self-contained, which is also what
+/// makes running its iterations concurrently sound.
+pub(crate) fn run_par_for(
+    ast: &Rc<Ast>,
+    body: NodeId,
+    var: Symbol,
+    iterable: Value,
+    span: &Span,
+) -> Result<Value> {
+    let items: Vec<PlainValue> = match &iterable {
+        Value::Range(range) => (range.start..range.end).map(PlainValue::Integer).collect(),
+        Value::Array(array) => array
+            .borrow()
+            .iter()
+            .map(|item| PlainValue::from_value(item, span))
+            .collect::<Result<_>>()?,
+        other => error!(span, "par for can only iterate an array or a range, got {:?}", other),
+    };
+    if items.is_empty() {
+        return Ok(Value::Array(make!(vec![])));
+    }
+
+    let encoded = crate::cache::encode(ast);
+    let body_index = body.index();
+    let var_name = var.as_str();
+    let filename = span.0.filename;
+    let span = *span;
+
+    let workers = std::thread::available_parallelism()
+        .map_or(1, |n| n.get())
+        .min(items.len());
+    let chunk_size = items.len().div_ceil(workers);
+
+    // Split the items into contiguous chunks, one worker per chunk, and
+    // stitch the per-chunk results back together in spawn order so the
+    // output array matches iteration order.
+    let mut chunks: Vec<Vec<PlainValue>> = vec![];
+    let mut items = items.into_iter();
+    loop {
+        let chunk: Vec<PlainValue> = items.by_ref().take(chunk_size).collect();
+        if chunk.is_empty() {
+            break;
+        }
+        chunks.push(chunk);
+    }
+
+    let results: Result<Vec<Vec<PlainValue>>> = std::thread::scope(|scope| {
+        let mut handles = vec![];
+        for chunk in chunks {
+            let encoded = &encoded;
+            let handle = std::thread::Builder::new()
+                .stack_size(WORKER_STACK_SIZE)
+                .spawn_scoped(scope, move || -> Result<Vec<PlainValue>> {
+                    let ast = match crate::cache::decode(encoded, filename) {
+                        Some(ast) => Rc::new(ast),
+                        None => error!(&span, "Internal error: couldn't decode par for body"),
+                    };
+                    let body = NodeId::from_index(body_index);
+                    let var = Symbol::intern(var_name);
+                    let mut interp = Interpreter::new();
+
+                    let mut results = Vec::with_capacity(chunk.len());
+                    for item in chunk {
+                        let scope = Scope::new(None, false);
+                        scope.borrow_mut().insert(var, item.into_value(), false, &span)?;
+                        let value = interp.run(&ast, body, scope)?;
+                        match std::mem::replace(&mut interp.control_flow, ControlFlow::None) {
+                            ControlFlow::None => {}
+                            _ => error!(
+                                &span,
+                                "break, continue and return are not supported in a par for body"
+                            ),
+                        }
+                        results.push(PlainValue::from_value(&value, &span)?);
+                    }
+                    Ok(results)
+                })
+                .expect("failed to spawn par for worker");
+            handles.push(handle);
+        }
+        handles
+            .into_iter()
+            .map(|handle| handle.join().expect("par for worker panicked"))
+            .collect()
+    });
+
+    let flattened = results?
+        .into_iter()
+        .flatten()
+        .map(PlainValue::into_value)
+        .collect::<Vec<_>>();
+    Ok(Value::Array(make!(flattened)))
+}
@@ -1,15 +1,22 @@
-use crate::ast::AST;
+use crate::ast::{Ast, NodeId};
+use crate::symbol::Symbol;
 use crate::common::{Ref, get, make, Span};
 use crate::error::{Result, runtime_error as error};
 use crate::interpreter::Scope;
 use std::rc::Rc;
 
+/// The trait object is boxed rather than held directly so the handle is a
+/// thin pointer; see the size note on `Value`. Items are `Result` so lazy
+/// adapters that call user functions (`map`, `filter`, ...) can surface
+/// errors at the point of consumption.
 #[derive(Clone)]
-pub struct IteratorValue(pub Ref<dyn Iterator<Item = Value>>);
+pub struct IteratorValue(pub Ref<Box<dyn Iterator<Item = Result<Value>>>>);
 
 struct StringIterator {
     string: Ref<String>,
-    index: usize,
+    /// Byte offset of the next character, so each step is O(1) instead of
+    /// re-scanning the string from the start.
+    offset: usize,
 }
 
 impl Iterator for StringIterator {
@@ -17,13 +24,9 @@ impl Iterator for StringIterator {
 
     fn next(&mut self) -> Option<Value> {
         let string = self.string.borrow();
-        if self.index >= string.len() {
-            None
-        } else {
-            let c = string.chars().nth(self.index).unwrap();
-            self.index += 1;
-            Some(Value::String(make!(c.to_string())))
-        }
+        let c = string[self.offset..].chars().next()?;
+        self.offset += c.len_utf8();
+        Some(Value::String(make!(c.to_string())))
     }
 }
 
@@ -47,17 +50,47 @@ impl Iterator for ArrayIterator {
     }
 }
 
+struct SliceIterator {
+    slice: Ref<SliceValue>,
+    index: usize,
+}
+
+impl Iterator for SliceIterator {
+    type Item = Value;
+
+    fn next(&mut self) -> Option<Value> {
+        let item = self.slice.borrow().at(self.index);
+        if item.is_some() {
+            self.index += 1;
+        }
+        item
+    }
+}
+
 impl IteratorValue {
+    fn new(iter: impl Iterator<Item = Value> + 'static) -> IteratorValue {
+        IteratorValue::fallible(iter.map(Ok))
+    }
+
+    pub fn fallible(iter: impl Iterator<Item = Result<Value>> + 'static) -> IteratorValue {
+        let iter: Box<dyn Iterator<Item = Result<Value>>> = Box::new(iter);
+        IteratorValue(make!(iter))
+    }
+
+    pub fn for_slice(slice: Ref<SliceValue>) -> IteratorValue {
+        IteratorValue::new(SliceIterator { slice, index: 0 })
+    }
+
     pub fn for_string(string: Ref<String>) -> IteratorValue {
-        IteratorValue(make!(StringIterator { string, index: 0 }))
+        IteratorValue::new(StringIterator { string, offset: 0 })
     }
 
     pub fn for_range(start: &i64, end: &i64) -> IteratorValue {
-        IteratorValue(make!((*start..*end).map(Value::Integer)))
+        IteratorValue::new((*start..*end).map(Value::Integer))
     }
 
     pub fn for_array(array: Ref<Vec<Value>>) -> IteratorValue {
-        IteratorValue(make!(ArrayIterator { array, index: 0 }))
+        IteratorValue::new(ArrayIterator { array, index: 0 })
     }
 }
 
@@ -67,12 +100,150 @@ impl std::fmt::Debug for IteratorValue {
     }
 }
 
+/// A zero-copy view of a string or array: `base` plus start/step/length in
+/// element (character) coordinates. `Value::slice` hands these out instead of
+/// copying; a concrete value is only built when the view reaches an operation
+/// that needs one (see `Value::materialize`).
+#[derive(Debug)]
+pub struct SliceValue {
+    base: Value,
+    start: usize,
+    step: usize,
+    len: usize,
+}
+
+impl SliceValue {
+    /// The string or array this view points into; used by the cycle
+    /// collector to trace through slices.
+    pub(crate) fn base(&self) -> &Value {
+        &self.base
+    }
+
+    pub fn len(&self) -> usize {
+        self.len
+    }
+
+    /// The element at view index `index`, or `None` when out of bounds.
+    pub fn at(&self, index: usize) -> Option<Value> {
+        if index >= self.len {
+            return None;
+        }
+        let base_index = self.start + index * self.step;
+        match &self.base {
+            Value::String(s) => {
+                let s = s.borrow();
+                let c = if s.is_ascii() {
+                    s.as_bytes().get(base_index).map(|b| *b as char)
+                } else {
+                    s.chars().nth(base_index)
+                };
+                c.map(|c| Value::String(make!(c.to_string())))
+            }
+            Value::Array(arr) => arr.borrow().get(base_index).cloned(),
+            _ => unreachable!("slice base must be a string or array"),
+        }
+    }
+
+    /// A further slice of this view, still sharing the original buffer.
+    fn reslice(&self, start: i64, end: i64, step: i64) -> SliceValue {
+        let len = sliced_len(start, end, step, self.len);
+        SliceValue {
+            base: self.base.clone(),
+            start: self.start + (start as usize) * self.step,
+            step: self.step * (step as usize),
+            len,
+        }
+    }
+
+    /// Build the concrete string or array this view denotes.
+    fn collect(&self) -> Value {
+        match &self.base {
+            Value::String(s) => {
+                let s = s.borrow();
+                let res = s
+                    .chars()
+                    .skip(self.start)
+                    .step_by(self.step.max(1))
+                    .take(self.len)
+                    .collect::<String>();
+                Value::String(make!(res))
+            }
+            Value::Array(arr) => {
+                let arr = arr.borrow();
+                let res = arr
+                    .iter()
+                    .skip(self.start)
+                    .step_by(self.step.max(1))
+                    .take(self.len)
+                    .cloned()
+                    .collect::<Vec<_>>();
+                Value::Array(make!(res))
+            }
+            _ => unreachable!("slice base must be a string or array"),
+        }
+    }
+}
+
+/// Number of elements selected by `[start:end:step]` over `base_len` elements,
+/// with the same out-of-range behaviour as iterator take/skip/step_by.
+fn sliced_len(start: i64, end: i64, step: i64, base_len: usize) -> usize {
+    let take = (end as usize).min(base_len);
+    let count = take.saturating_sub(start as usize);
+    if count == 0 {
+        0
+    } else {
+        (count - 1) / (step as usize).max(1) + 1
+    }
+}
+
 pub struct Function {
     pub span: Span,
     pub name: String,
-    pub body: Rc<AST>,
-    pub args: Vec<String>,
+    /// The arena the function was parsed into, kept alive for `body`.
+    pub ast: Rc<Ast>,
+    pub body: NodeId,
+    pub args: Vec<Symbol>,
     pub scope: Ref<Scope>,
+    /// Compiled form of `body`, filled in lazily by the VM on first call.
+    pub chunk: Option<Rc<crate::vm::Chunk>>,
+}
+
+impl std::fmt::Debug for Function {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        write!(f, "<function {}: {}>", self.name, self.span.0)
+    }
+}
+
+/// A hashable dictionary key. Only the immutable value types qualify, so a
+/// key copies its data out of the `Value` instead of sharing a `Ref`.
+#[derive(Debug, Clone, PartialEq, Eq, Hash)]
+pub enum DictKey {
+    Integer(i64),
+    Boolean(bool),
+    String(String),
+}
+
+impl DictKey {
+    pub fn to_value(&self) -> Value {
+        match self {
+            DictKey::Integer(num) => Value::Integer(*num),
+            DictKey::Boolean(val) => Value::Boolean(*val),
+            DictKey::String(string) => Value::String(make!(string.clone())),
+        }
+    }
+}
+
+/// Dictionaries use FxHash: identical quality to SipHash for our short
+/// integer/string keys at a fraction of the cost, and we don't need
+/// DoS-resistant hashing inside a script's own data.
+pub type Dict = rustc_hash::FxHashMap<DictKey, Value>;
+
+/// A range's endpoints, shared behind an `Rc` so `Value::Range` stays
+/// pointer-sized.
+#[derive(Debug)]
+pub struct RangeValue {
+    pub start: i64,
+    pub end: i64,
 }
 
 #[derive(Clone)]
@@ -81,14 +252,21 @@ pub enum Value {
     Float(f64),
     Boolean(bool),
     String(Ref<String>),
-    BuiltInFunction(Ref<String>),
+    BuiltInFunction(&'static crate::interpreter::BuiltIn),
     Function(Ref<Function>),
     Iterator(IteratorValue),
-    Range(i64, i64),
+    Range(Rc<RangeValue>),
     Array(Ref<Vec<Value>>),
+    Dict(Ref<Dict>),
+    Slice(Ref<SliceValue>),
     Nothing,
 }
 
+// Every payload is at most one word, so a value is tag + pointer/scalar:
+// 16 bytes instead of the 24 the wide `Range`/`Iterator` payloads forced.
+// Arrays pack tighter and the clone in `Scope::get` is a register copy.
+const _: () = assert!(std::mem::size_of::<Value>() == 16);
+
 impl std::fmt::Debug for Value {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
         match self {
@@ -98,12 +276,13 @@ impl std::fmt::Debug for Value {
             Value::Boolean(boolean) => write!(f, "{}", boolean),
             Value::Nothing => write!(f, "nothing"),
             Value::Iterator(_) => write!(f, "<iterator>"),
-            Value::Range(start, end) => write!(f, "{}..{}", start, end),
-            Value::BuiltInFunction(name) => write!(f, "<builtin {}>", name.borrow()),
+            Value::Range(range) => write!(f, "{}..{}", range.start, range.end),
+            Value::BuiltInFunction(builtin) => write!(f, "<builtin {}>", builtin.name),
             Value::Function(func) => {
                 let func = func.borrow();
                 write!(f, "<function {}: {}>", func.name, func.span.0)
             }
+            Value::Slice(slice) => write!(f, "{:?}", slice.borrow().collect()),
             Value::Array(array) => {
                 write!(f, "[")?;
                 for (i, item) in array.borrow().iter().enumerate() {
@@ -114,20 +293,44 @@ impl std::fmt::Debug for Value {
                 }
                 write!(f, "]")
             }
+            Value::Dict(map) => {
+                write!(f, "{{")?;
+                for (i, (key, value)) in map.borrow().iter().enumerate() {
+                    if i > 0 {
+                        write!(f, ", ")?;
+                    }
+                    write!(f, "{}: {:?}", key.to_value().repr(), value)?;
+                }
+                write!(f, "}}")
+            }
         }
     }
 }
 
 impl std::cmp::PartialEq for Value {
     fn eq(&self, other: &Self) -> bool {
+        if matches!(self, Value::Slice(_)) || matches!(other, Value::Slice(_)) {
+            return self.materialize() == other.materialize();
+        }
         match (self, other) {
             (Value::Integer(left), Value::Integer(right)) => *left == *right,
             (Value::Integer(left), Value::Float(right)) => *left as f64 == *right,
             (Value::Float(left), Value::Float(right)) => *left == *right,
             (Value::Float(left), Value::Integer(right)) => *left == *right as f64,
-            (Value::String(left), Value::String(right)) => *left.borrow() == *right.borrow(),
+            // Identity short-circuits: a buffer always equals itself, so
+            // comparing an array (or dict, or string) against another handle
+            // to the same allocation is O(1) instead of element-by-element.
+            (Value::String(left), Value::String(right)) => {
+                Rc::ptr_eq(left, right) || *left.borrow() == *right.borrow()
+            }
             (Value::Boolean(left), Value::Boolean(right)) => *left == *right,
+            (Value::Dict(left), Value::Dict(right)) => {
+                Rc::ptr_eq(left, right) || *left.borrow() == *right.borrow()
+            }
             (Value::Array(left), Value::Array(right)) => {
+                if Rc::ptr_eq(left, right) {
+                    return true;
+                }
                 let left = left.borrow();
                 let right = right.borrow();
                 if left.len() != right.len() {
@@ -143,6 +346,9 @@ impl std::cmp::PartialEq for Value {
 
 impl Value {
     pub fn plus(&self, other: &Value, span: &Span) -> Result<Value> {
+        if matches!(self, Value::Slice(_)) || matches!(other, Value::Slice(_)) {
+            return self.materialize().plus(&other.materialize(), span);
+        }
         Ok(match (self, other) {
             (Value::Integer(left), Value::Integer(right)) => Value::Integer(*left + *right),
             (Value::Integer(left), Value::Float(right)) => Value::Float(*left as f64 + *right),
@@ -164,6 +370,9 @@ impl Value {
     }
 
     pub fn multiply(&self, other: &Value, span: &Span) -> Result<Value> {
+        if matches!(self, Value::Slice(_)) || matches!(other, Value::Slice(_)) {
+            return self.materialize().multiply(&other.materialize(), span);
+        }
         Ok(match (self, other) {
             (Value::Integer(left), Value::Integer(right)) => Value::Integer(*left * *right),
             (Value::Integer(left), Value::Float(right)) => Value::Float(*left as f64 * *right),
@@ -210,21 +419,69 @@ impl Value {
 
         match self {
             Value::String(s) => {
-                let s = s.borrow();
-                let (start, end, step) = get_slice_params(span, start, end, step, s.len() as i64)?;
-                let res = s.chars().take(end as usize).skip(start as usize).step_by(step as usize).collect::<String>();
-                Ok(Value::String(make!(res)))
+                let base_len = s.borrow().chars().count();
+                let (start, end, step) = get_slice_params(span, start, end, step, base_len as i64)?;
+                let len = sliced_len(start, end, step, base_len);
+                Ok(Value::Slice(make!(SliceValue {
+                    base: self.clone(),
+                    start: start as usize,
+                    step: (step as usize).max(1),
+                    len,
+                })))
             },
             Value::Array(a) => {
-                let a = a.borrow();
-                let (start, end, step) = get_slice_params(span, start, end, step, a.len() as i64)?;
-                let res = a.iter().take(end as usize).skip(start as usize).step_by(step as usize).cloned().collect::<Vec<_>>();
-                Ok(Value::Array(make!(res)))
+                let base_len = a.borrow().len();
+                let (start, end, step) = get_slice_params(span, start, end, step, base_len as i64)?;
+                let len = sliced_len(start, end, step, base_len);
+                Ok(Value::Slice(make!(SliceValue {
+                    base: self.clone(),
+                    start: start as usize,
+                    step: (step as usize).max(1),
+                    len,
+                })))
+            },
+            Value::Slice(view) => {
+                let view = view.borrow();
+                let (start, end, step) = get_slice_params(span, start, end, step, view.len() as i64)?;
+                Ok(Value::Slice(make!(view.reslice(start, end, step))))
             },
             _ => error!(span, "Can only slice strings"),
         }
     }
 
+    /// Collapse a slice view into the concrete string or array it denotes;
+    /// any other value is returned as-is. Operations that need contiguous
+    /// data call this instead of teaching every arm about views.
+    pub fn materialize(&self) -> Value {
+        match self {
+            Value::Slice(view) => view.borrow().collect(),
+            other => other.clone(),
+        }
+    }
+
+    /// A deep, independent copy: fresh buffers for strings, arrays and
+    /// dicts, all the way down. Immutable payloads (numbers, ranges,
+    /// functions, iterators) stay shared — copying can't change what they
+    /// mean.
+    pub fn deep_copy(&self) -> Value {
+        match &self.materialize() {
+            Value::String(string) => Value::String(make!(string.borrow().clone())),
+            Value::Array(array) => Value::Array(make!(array
+                .borrow()
+                .iter()
+                .map(Value::deep_copy)
+                .collect::<Vec<_>>())),
+            Value::Dict(map) => {
+                let mut copy = Dict::default();
+                for (key, value) in map.borrow().iter() {
+                    copy.insert(key.clone(), value.deep_copy());
+                }
+                Value::Dict(make!(copy))
+            }
+            other => other.clone(),
+        }
+    }
+
     pub fn not(&self, span: &Span) -> Result<Value> {
         Ok(match self {
             Value::Boolean(b) => Value::Boolean(!b),
@@ -251,6 +508,9 @@ impl Value {
         Ok(Value::Boolean(self != other))
     }
     pub fn less_than(&self, other: &Value, span: &Span) -> Result<Value> {
+        if matches!(self, Value::Slice(_)) || matches!(other, Value::Slice(_)) {
+            return self.materialize().less_than(&other.materialize(), span);
+        }
         Ok(match (self, other) {
             (Value::Integer(left), Value::Integer(right)) => Value::Boolean(*left < *right),
             (Value::Integer(left), Value::Float(right)) => Value::Boolean((*left as f64) < *right),
@@ -266,6 +526,9 @@ impl Value {
     }
 
     pub fn less_equals(&self, other: &Value, span: &Span) -> Result<Value> {
+        if matches!(self, Value::Slice(_)) || matches!(other, Value::Slice(_)) {
+            return self.materialize().less_equals(&other.materialize(), span);
+        }
         Ok(match (self, other) {
             (Value::Integer(left), Value::Integer(right)) => Value::Boolean(*left <= *right),
             (Value::Integer(left), Value::Float(right)) => Value::Boolean((*left as f64) <= *right),
@@ -282,9 +545,19 @@ impl Value {
 
     pub fn iterator(&self, span: &Span) -> Result<Value> {
         Ok(match self {
+            // Already an iterator (e.g. a lazy map/filter chain): shares the
+            // underlying cursor, it does not restart.
+            Value::Iterator(iter) => Value::Iterator(iter.clone()),
             Value::String(s) => Value::Iterator(IteratorValue::for_string(s.clone())),
-            Value::Range(start, end) => Value::Iterator(IteratorValue::for_range(start, end)),
+            Value::Range(range) => Value::Iterator(IteratorValue::for_range(&range.start, &range.end)),
             Value::Array(arr) => Value::Iterator(IteratorValue::for_array(arr.clone())),
+            Value::Slice(view) => Value::Iterator(IteratorValue::for_slice(view.clone())),
+            Value::Dict(map) => {
+                // Iterates over the keys; snapshotting them keeps the map
+                // free to be mutated while the loop runs.
+                let keys: Vec<Value> = map.borrow().keys().map(DictKey::to_value).collect();
+                Value::Iterator(IteratorValue::new(keys.into_iter()))
+            }
             _ => error!(span, "Cannot iterate over this type"),
         })
     }
@@ -301,9 +574,24 @@ impl Value {
                 let func = func.borrow();
                 format!("<function {}: {}>", func.name, func.span.0)
             }
-            Value::Range(start, end) => format!("{}..{}", start, end),
-            Value::BuiltInFunction(name) => format!("<built-in function {}>", name.borrow()),
+            Value::Range(range) => format!("{}..{}", range.start, range.end),
+            Value::BuiltInFunction(builtin) => format!("<built-in function {}>", builtin.name),
             Value::Nothing => "nothing".to_string(),
+            Value::Slice(view) => view.borrow().collect().repr(),
+            Value::Dict(map) => {
+                let map = map.borrow();
+                let mut s = "{".to_string();
+                for (i, (key, value)) in map.iter().enumerate() {
+                    if i > 0 {
+                        s.push_str(", ");
+                    }
+                    s.push_str(&key.to_value().repr());
+                    s.push_str(": ");
+                    s.push_str(&value.repr());
+                }
+                s.push('}');
+                s
+            }
             Value::Array(arr) => {
                 let arr = arr.borrow();
                 let mut s = "[".to_string();
@@ -321,26 +609,97 @@ impl Value {
 
     pub fn create_range(start: &Value, end: &Value, span: &Span) -> Result<Value> {
         Ok(match (start, end) {
-            (Value::Integer(start), Value::Integer(end)) => Value::Range(*start, *end),
+            (Value::Integer(start), Value::Integer(end)) => Value::Range(Rc::new(RangeValue {
+                start: *start,
+                end: *end,
+            })),
             _ => error!(span, "Must be integers for range"),
         })
     }
 
+    /// `left + right` where `left` may be consumed. For strings, `take` is
+    /// called to release the caller's binding first; if that leaves `left`
+    /// unaliased the append happens in place with no copy of the accumulator.
+    pub fn append<F>(left: Value, right: &Value, span: &Span, take: F) -> Result<Value>
+    where
+        F: FnOnce() -> Result<()>,
+    {
+        if let (Value::String(ls), Value::String(rs)) = (&left, right) {
+            take()?;
+            if Rc::strong_count(ls) == 1 {
+                ls.borrow_mut().push_str(&rs.borrow());
+                return Ok(left);
+            }
+            let mut out = String::with_capacity(ls.borrow().len() + rs.borrow().len());
+            out.push_str(&ls.borrow());
+            out.push_str(&rs.borrow());
+            return Ok(Value::String(make!(out)));
+        }
+        left.plus(right, span)
+    }
+
     pub fn index(&self, index: &Value, span: &Span) -> Result<Value> {
         Ok(match (self, index) {
             (Value::String(s), Value::Integer(index)) => {
-                match s.borrow().chars().nth(*index as usize) {
+                let s = s.borrow();
+                let index = *index as usize;
+                // ASCII strings (the common case) index directly by byte;
+                // anything else falls back to counting characters.
+                let c = if s.is_ascii() {
+                    s.as_bytes().get(index).map(|b| *b as char)
+                } else {
+                    s.chars().nth(index)
+                };
+                match c {
                     Some(c) => Value::String(make!(c.to_string())),
                     None => error!(span, "Index out of bounds"),
                 }
             }
+            (Value::Slice(view), Value::Integer(index)) => {
+                match view.borrow().at(*index as usize) {
+                    Some(v) => v,
+                    None => error!(span, "Index out of bounds"),
+                }
+            }
             (Value::Array(arr), Value::Integer(index)) => {
                 match arr.borrow().get(*index as usize) {
                     Some(v) => v.clone(),
                     None => error!(span, "Index out of bounds"),
                 }
             }
+            (Value::Dict(map), key) => match map.borrow().get(&key.dict_key(span)?) {
+                Some(v) => v.clone(),
+                None => error!(span, "Key {} not found", key.repr()),
+            },
             (value, index) => error!(span, "Can't index {:?} with {:?}", value, index),
         })
     }
+
+    pub fn dict_key(&self, span: &Span) -> Result<DictKey> {
+        Ok(match self {
+            Value::Integer(num) => DictKey::Integer(*num),
+            Value::Boolean(val) => DictKey::Boolean(*val),
+            Value::String(string) => DictKey::String(string.borrow().clone()),
+            Value::Slice(_) => self.materialize().dict_key(span)?,
+            _ => error!(span, "Can't use {:?} as a dictionary key", self),
+        })
+    }
+
+    /// `target[index] = value` for container types; mutates in place.
+    pub fn set_index(&self, index: &Value, value: Value, span: &Span) -> Result<()> {
+        match (self, index) {
+            (Value::Dict(map), _) => {
+                map.borrow_mut().insert(index.dict_key(span)?, value);
+                Ok(())
+            }
+            (Value::Array(arr), Value::Integer(index)) => {
+                match arr.borrow_mut().get_mut(*index as usize) {
+                    Some(slot) => *slot = value,
+                    None => error!(span, "Index out of bounds"),
+                }
+                Ok(())
+            }
+            _ => error!(span, "Can't assign into {:?}", self),
+        }
+    }
 }
\ No newline at end of file
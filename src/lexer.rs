@@ -1,35 +1,49 @@
 use crate::error::{lexer_error as error, Result};
 use crate::common::{Location, Span};
 use crate::token::{Token, TokenKind};
+use std::rc::Rc;
 
 #[derive(Debug)]
 pub struct Lexer {
     location: Location,
-    input: String,
+    /// Shared with every token, which carry byte ranges into it instead of
+    /// owning copies of their text.
+    input: Rc<str>,
     current_index: usize,
     seen_newline: bool,
 }
 
 impl Lexer {
     pub fn new(input: String, filename: &'static str) -> Lexer {
+        Lexer::new_starting_at(input, filename, 1)
+    }
+
+    /// A lexer whose spans start at the (1-based) `line`; used by the REPL,
+    /// which lexes each continuation line on its own instead of re-lexing
+    /// the whole accumulated buffer.
+    pub fn new_starting_at(input: String, filename: &'static str, line: usize) -> Lexer {
         Lexer {
             location: Location {
-                line: 1,
+                line,
                 column: 1,
                 filename,
             },
-            input,
+            input: input.into(),
             current_index: 0,
-            seen_newline: false,
+            // A continuation line begins after a newline, so its first token
+            // separates statements just as it would in a single buffer.
+            seen_newline: line > 1,
         }
     }
 
+    // `current_index` is a byte offset, so these only ever decode a char or
+    // two at the current position instead of rescanning the whole input.
     fn cur(&self) -> Option<char> {
-        self.input.chars().nth(self.current_index)
+        self.input[self.current_index..].chars().next()
     }
 
     fn peek(&self, offset: usize) -> Option<char> {
-        self.input.chars().nth(self.current_index + offset)
+        self.input[self.current_index..].chars().nth(offset)
     }
 
     fn increment(&mut self) {
@@ -40,8 +54,8 @@ impl Lexer {
                 self.current_index += 1;
                 self.seen_newline = true;
             }
-            Some(_) => {
-                self.current_index += 1;
+            Some(c) => {
+                self.current_index += c.len_utf8();
                 self.location.column += 1;
             }
             None => {}
@@ -54,11 +68,12 @@ impl Lexer {
 
     fn push_simple(&mut self, tokens: &mut Vec<Token>, kind: TokenKind, len: usize) {
         let start = self.loc();
-        let text = self.input[self.current_index..self.current_index + len].to_string();
+        let range = (self.current_index, self.current_index + len);
         for _ in 0..len {
             self.increment();
         }
-        self.push(tokens, Token::new(kind, Span(start, self.loc()), text));
+        let token = Token::new(kind, Span(start, self.loc()), self.input.clone(), range);
+        self.push(tokens, token);
     }
 
     fn push(&mut self, tokens: &mut Vec<Token>, mut token: Token) {
@@ -76,8 +91,6 @@ impl Lexer {
 
                 // base N literals, i.e. 0b_1101, 0o_567, 0x_ff
                 '0' if self.peek(1).map_or(false, |c| "box".contains(c)) => {
-                    let mut num = String::new();
-
                     let base = match self.peek(1) {
                         Some('b') => Base::Bin,
                         Some('o') => Base::Oct,
@@ -88,53 +101,46 @@ impl Lexer {
                     self.increment();
                     self.increment();
 
-                    self.lex_num(&mut num, base, &start)?;
-                    self.push(
-                        &mut tokens,
-                        Token::new(base.into(), Span(start, self.loc()), num),
-                    );
+                    // The range starts past the `0x` prefix; the parser
+                    // strips any `_` separators.
+                    let text_start = self.current_index;
+                    self.lex_num(base, &start)?;
+                    let range = (text_start, self.current_index);
+                    let token =
+                        Token::new(base.into(), Span(start, self.loc()), self.input.clone(), range);
+                    self.push(&mut tokens, token);
                 }
 
                 // decimal int/float literals
                 '0'..='9' => {
-                    let mut num = String::new();
-
-                    self.lex_num(&mut num, Base::Dec, &start)?;
-                    if let Some('.') = self.cur() {
-                        if let Some('.') = self.peek(1) {
-                            self.push(
-                                &mut tokens,
-                                Token::new(
-                                    TokenKind::IntegerLiteralDec,
-                                    Span(start, self.loc()),
-                                    num,
-                                ),
-                            );
-                        } else {
-                            num.push('.');
-                            self.increment();
-                            self.lex_num(&mut num, Base::Dec, &start)?;
-                            self.push(
-                                &mut tokens,
-                                Token::new(TokenKind::FloatLiteral, Span(start, self.loc()), num),
-                            );
-                        }
-                    } else {
-                        self.push(
-                            &mut tokens,
-                            Token::new(TokenKind::IntegerLiteralDec, Span(start, self.loc()), num),
-                        );
+                    let text_start = self.current_index;
+                    self.lex_num(Base::Dec, &start)?;
+                    let mut kind = TokenKind::IntegerLiteralDec;
+                    // A second `.` is a range, not a float.
+                    if self.cur() == Some('.') && self.peek(1) != Some('.') {
+                        self.increment();
+                        self.lex_num(Base::Dec, &start)?;
+                        kind = TokenKind::FloatLiteral;
                     }
+                    let range = (text_start, self.current_index);
+                    let token =
+                        Token::new(kind, Span(start, self.loc()), self.input.clone(), range);
+                    self.push(&mut tokens, token);
                 }
                 '+' => match self.peek(1) {
                     Some('+') => self.push_simple(&mut tokens, TokenKind::PlusPlus, 2),
+                    Some('=') => self.push_simple(&mut tokens, TokenKind::PlusEquals, 2),
                     _ => self.push_simple(&mut tokens, TokenKind::Plus, 1),
                 },
                 '-' => match self.peek(1) {
                     Some('-') => self.push_simple(&mut tokens, TokenKind::MinusMinus, 2),
+                    Some('=') => self.push_simple(&mut tokens, TokenKind::MinusEquals, 2),
                     _ => self.push_simple(&mut tokens, TokenKind::Minus, 1),
                 },
-                '*' => self.push_simple(&mut tokens, TokenKind::Star, 1),
+                '*' => match self.peek(1) {
+                    Some('=') => self.push_simple(&mut tokens, TokenKind::StarEquals, 2),
+                    _ => self.push_simple(&mut tokens, TokenKind::Star, 1),
+                },
                 '/' => match self.peek(1) {
                     Some('/') => {
                         while let Some(c) = self.cur() {
@@ -144,6 +150,7 @@ impl Lexer {
                             }
                         }
                     }
+                    Some('=') => self.push_simple(&mut tokens, TokenKind::SlashEquals, 2),
                     _ => self.push_simple(&mut tokens, TokenKind::Slash, 1),
                 },
                 '(' => self.push_simple(&mut tokens, TokenKind::LeftParen, 1),
@@ -185,17 +192,13 @@ impl Lexer {
 
                 // identifiers
                 'a'..='z' | 'A'..='Z' | '_' => {
-                    let mut ident = String::new();
-                    while let Some(c) = self.cur() {
-                        match c {
-                            'a'..='z' | 'A'..='Z' | '0'..='9' | '_' => {
-                                ident.push(c);
-                                self.increment();
-                            }
-                            _ => break,
-                        }
+                    let text_start = self.current_index;
+                    while let Some('a'..='z' | 'A'..='Z' | '0'..='9' | '_') = self.cur() {
+                        self.increment();
                     }
-                    self.push(&mut tokens, Token::from_str(ident, Span(start, self.loc())));
+                    let range = (text_start, self.current_index);
+                    let token = Token::from_str(self.input.clone(), range, Span(start, self.loc()));
+                    self.push(&mut tokens, token);
                 }
                 _ => error!(Span(start, self.loc()), "Unexpected character {}", c),
             }
@@ -206,39 +209,36 @@ impl Lexer {
 
     fn lex_string_literal(&mut self) -> Result<Token> {
         let start = self.loc();
-        let mut string = String::new();
         self.increment();
+        let text_start = self.current_index;
         while let Some(c) = self.cur() {
             match c {
                 '"' => {
+                    let range = (text_start, self.current_index);
                     self.increment();
                     return Ok(Token::new(
                         TokenKind::StringLiteral,
                         Span(start, self.loc()),
-                        string,
+                        self.input.clone(),
+                        range,
                     ));
                 }
                 '\n' => break,
-                _ => {
-                    string.push(c);
-                    self.increment();
-                }
+                _ => self.increment(),
             }
         }
         error!(Span(start, self.loc()), "Unterminated string literal");
     }
 
-    fn lex_num(&mut self, num: &mut String, base: Base, start: &Location) -> Result<()> {
-        while let Some(mut c) = self.cur() {
-            c = c.to_ascii_lowercase();
-            match (base, c) {
+    /// Validates and skips over the digits of a numeric literal; the token's
+    /// byte range covers them, so nothing is copied here.
+    fn lex_num(&mut self, base: Base, start: &Location) -> Result<()> {
+        while let Some(c) = self.cur() {
+            match (base, c.to_ascii_lowercase()) {
                 (Base::Bin, '0'..='1')
                 | (Base::Oct, '0'..='7')
                 | (Base::Dec, '0'..='9')
-                | (Base::Hex, '0'..='9' | 'a'..='f') => {
-                    num.push(c);
-                    self.increment();
-                }
+                | (Base::Hex, '0'..='9' | 'a'..='f') => self.increment(),
                 (_, '0'..='9' | 'a'..='f') => {
                     error!(Span(*start, self.loc()), "Invalid numerical literal");
                 }
@@ -268,3 +268,31 @@ impl From<Base> for TokenKind {
         }
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn lexes_large_input_in_linear_time() {
+        // A few MB of representative code. With the old chars().nth() cursor
+        // this took minutes (quadratic in input size); it should now be well
+        // under a second even in debug builds.
+        let line = "let some_variable = (1234 + foo) * \"string literal\" // comment\n";
+        let input = line.repeat(50_000);
+        let num_lines = input.lines().count();
+
+        let start = std::time::Instant::now();
+        let mut lexer = Lexer::new(input, "<test>");
+        let tokens = lexer.lex().expect("lexing failed");
+        let elapsed = start.elapsed();
+
+        // 10 tokens per line (comment is dropped), plus EOF.
+        assert_eq!(tokens.len(), num_lines * 10 + 1);
+        assert!(
+            elapsed < std::time::Duration::from_secs(5),
+            "lexing took too long: {:?}",
+            elapsed
+        );
+    }
+}
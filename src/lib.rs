@@ -0,0 +1,19 @@
+#![allow(clippy::upper_case_acronyms)]
+// Clippy is being annoying with this one, so we'll just ignore it.
+#![allow(clippy::let_and_return)]
+
+pub mod ast;
+pub mod cache;
+pub mod common;
+pub mod error;
+pub mod interpreter;
+pub mod lexer;
+pub mod module;
+pub mod optimizer;
+pub mod parser;
+pub mod profiler;
+pub mod repl;
+pub mod resolver;
+pub mod symbol;
+pub mod token;
+pub mod vm;
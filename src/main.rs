@@ -1,41 +1,97 @@
-#![allow(clippy::upper_case_acronyms)]
-// Clippy is being annoying with this one, so we'll just ignore it.
-#![allow(clippy::let_and_return)]
-
-use crate::error::Result;
-
-mod ast;
-mod error;
-mod interpreter;
-mod lexer;
-mod parser;
-mod common;
-mod repl;
-mod token;
-
-fn run_file(filename: &str) -> Result<()> {
+use serpens::error::Result;
+use serpens::{cache, interpreter, lexer, module, optimizer, parser, profiler, repl, resolver, vm};
+
+/// The tree-walking interpreter recurses on the native stack, so scripts run
+/// on a thread with plenty of headroom for the recursion limit.
+const INTERPRETER_STACK_SIZE: usize = 1024 * 1024 * 1024;
+
+fn run_file(filename: &str, tree_walk: bool, recursion_limit: Option<usize>) -> Result<()> {
     let content = std::fs::read_to_string(filename).expect("Couldn't open input file");
+    let static_name: &'static str = Box::leak(filename.to_string().into_boxed_str());
 
-    let mut lex = lexer::Lexer::new(content, Box::leak(filename.to_string().into_boxed_str()));
-    let tokens = lex.lex()?;
+    // Launching the same script repeatedly skips the lex/parse/optimize
+    // pipeline entirely when a cache written by a previous run still matches
+    // the source hash.
+    let hash = cache::source_hash(&content);
+    let spc = cache::cache_path(filename);
+    let ast = match cache::load(&spc, hash, static_name) {
+        Some(ast) => ast,
+        None => {
+            let mut lex = lexer::Lexer::new(content, static_name);
+            let tokens = lex.lex()?;
 
-    let mut parser = parser::Parser::new(tokens);
-    let ast = parser.parse()?;
+            let mut parser = parser::Parser::new(tokens);
+            let mut ast = parser.parse()?;
+            optimizer::Optimizer::optimize(&mut ast);
+            cache::store(&spc, hash, &ast);
+            ast
+        }
+    };
+    let ast = std::rc::Rc::new(ast);
+    // Parse the whole import graph up front, across a thread pool, so the
+    // first `import` of each module finds it ready to run.
+    module::preload(&ast, static_name);
 
-    let mut interpreter = interpreter::Interpreter::new();
-    interpreter.execute(&ast)?;
-    Ok(())
+    let result = if tree_walk {
+        resolver::Resolver::resolve(&ast);
+        let mut interpreter = interpreter::Interpreter::new();
+        if let Some(limit) = recursion_limit {
+            interpreter.set_recursion_limit(limit);
+        }
+        interpreter.execute(&ast).map(|_| ())
+    } else {
+        let chunk = vm::compiler::Compiler::compile_program(&ast)?;
+        let mut vm = vm::Vm::new();
+        if let Some(limit) = recursion_limit {
+            vm.set_recursion_limit(limit);
+        }
+        vm.run(std::rc::Rc::new(chunk))
+    };
+    // Flush on this thread, which owns the output buffer, so buffered output
+    // lands before any error is reported. The profile report goes to stderr
+    // afterwards, for the same reason.
+    interpreter::flush_output();
+    if profiler::enabled() {
+        profiler::report();
+    }
+    result
 }
 
 fn main() {
     let args = std::env::args().collect::<Vec<String>>();
-    if args.len() == 1 {
+    let tree_walk = args.iter().any(|arg| arg == "--ast");
+    let profile = args.iter().any(|arg| arg == "--profile");
+    let recursion_limit = args.iter().find_map(|arg| {
+        arg.strip_prefix("--recursion-limit=")
+            .and_then(|limit| limit.parse().ok())
+    });
+    let files = args[1..]
+        .iter()
+        .filter(|arg| !arg.starts_with("--"))
+        .collect::<Vec<_>>();
+
+    if files.is_empty() {
         let mut repl = repl::Repl::new();
         repl.run();
         std::process::exit(0);
     }
 
-    match run_file(&args[1]) {
+    let filename = files[0].clone();
+    let result = std::thread::Builder::new()
+        .stack_size(INTERPRETER_STACK_SIZE)
+        .spawn(move || {
+            // Profiling state is thread-local; enable it on the thread that
+            // actually runs the script.
+            if profile {
+                profiler::enable();
+            }
+            run_file(&filename, tree_walk, recursion_limit)
+        })
+        .expect("failed to spawn interpreter thread")
+        .join()
+        .expect("interpreter thread panicked");
+
+    match result {
         Ok(_) => std::process::exit(0),
         Err(err) => {
             err.print_with_source();
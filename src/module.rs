@@ -0,0 +1,175 @@
+use crate::ast::{Ast, NodeId, AST};
+use crate::common::Span;
+use crate::error::{runtime_error as error, Result};
+use crate::interpreter::value::Value;
+use crate::interpreter::{Interpreter, Scope};
+use crate::symbol::Symbol;
+use crate::{cache, lexer, optimizer, parser};
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::path::{Path, PathBuf};
+use std::rc::Rc;
+
+// `import "path.sp"` support. A module is an ordinary script: importing it
+// runs its top level once, in its own scope, and copies the resulting
+// bindings into the importing scope. The front-end (lex + parse + optimize)
+// is pure, so `preload` runs it for the whole import graph on a thread pool
+// before execution starts, and every module keeps its own `.spc` cache —
+// touching one file only re-parses that file.
+
+thread_local! {
+    /// Modules whose front-end has run, keyed by resolved path.
+    static PARSED: RefCell<HashMap<PathBuf, Rc<Ast>>> = RefCell::new(HashMap::new());
+    /// Modules whose top level has run. `None` marks one mid-execution, so
+    /// an import cycle is reported instead of recursing forever.
+    static EXECUTED: RefCell<HashMap<PathBuf, Option<Vec<(Symbol, Value)>>>> =
+        RefCell::new(HashMap::new());
+}
+
+/// Resolve an import path relative to the file containing the `import`.
+fn resolve(importer: &str, path: &str) -> PathBuf {
+    let base = Path::new(importer).parent().unwrap_or_else(|| Path::new(""));
+    let joined = base.join(path);
+    joined.canonicalize().unwrap_or(joined)
+}
+
+/// Every path imported (directly) somewhere in the arena. Dead nodes are
+/// scanned too; preloading an unreachable import is harmless.
+fn imports_of(ast: &Ast, filename: &str) -> Vec<PathBuf> {
+    let mut paths = vec![];
+    for i in 0..ast.len() {
+        if let AST::Import(_, path) = &ast[NodeId::from_index(i as u32)] {
+            paths.push(resolve(filename, path));
+        }
+    }
+    paths
+}
+
+/// Run the front-end for one module and return the `cache::encode`d arena.
+/// Symbols are stored by name in that form, so this is safe to call on a
+/// worker thread whose interner the main thread never sees. `None` means
+/// the file couldn't be read or parsed; the import reports that itself when
+/// it executes, with the importing span attached.
+fn front_end(path: &Path) -> Option<Vec<u8>> {
+    let display = path.display().to_string();
+    let content = std::fs::read_to_string(path).ok()?;
+    let hash = cache::source_hash(&content);
+    let spc = cache::cache_path(&display);
+    if let Some(payload) = cache::load_payload(&spc, hash) {
+        return Some(payload);
+    }
+
+    let static_name: &'static str = Box::leak(display.into_boxed_str());
+    let tokens = lexer::Lexer::new(content, static_name).lex().ok()?;
+    let mut ast = parser::Parser::new(tokens).parse().ok()?;
+    optimizer::Optimizer::optimize(&mut ast);
+    let payload = cache::encode(&ast);
+    cache::store_payload(&spc, hash, &payload);
+    Some(payload)
+}
+
+/// Run the front-end across the import graph of `ast` on a thread pool,
+/// one wave of not-yet-parsed modules at a time, so execution never stops
+/// to parse. Failures are left for the corresponding `import` to report.
+pub fn preload(ast: &Ast, filename: &str) {
+    let mut frontier = imports_of(ast, filename);
+    while !frontier.is_empty() {
+        frontier.retain(|path| PARSED.with(|parsed| !parsed.borrow().contains_key(path)));
+        frontier.sort();
+        frontier.dedup();
+        let payloads: Vec<Option<Vec<u8>>> = std::thread::scope(|scope| {
+            let handles: Vec<_> = frontier
+                .iter()
+                .map(|path| scope.spawn(move || front_end(path)))
+                .collect();
+            handles
+                .into_iter()
+                .map(|handle| handle.join().expect("module front-end panicked"))
+                .collect()
+        });
+
+        let mut next = vec![];
+        for (path, payload) in std::mem::take(&mut frontier).into_iter().zip(payloads) {
+            let Some(payload) = payload else { continue };
+            let static_name: &'static str =
+                Box::leak(path.display().to_string().into_boxed_str());
+            let Some(module_ast) = cache::decode(&payload, static_name) else { continue };
+            next.extend(imports_of(&module_ast, static_name));
+            PARSED.with(|parsed| parsed.borrow_mut().insert(path, Rc::new(module_ast)));
+        }
+        frontier = next;
+    }
+}
+
+/// The front-end for a module that wasn't preloaded (a REPL import, or a
+/// file that appeared after preload). Unlike `front_end` this propagates
+/// lex/parse errors, since the importer is waiting on the result.
+fn load_now(path: &PathBuf, span: &Span) -> Result<Rc<Ast>> {
+    let display = path.display().to_string();
+    let Ok(content) = std::fs::read_to_string(path) else {
+        error!(span, "Couldn't read module {}", display)
+    };
+    let hash = cache::source_hash(&content);
+    let spc = cache::cache_path(&display);
+    let static_name: &'static str = Box::leak(display.into_boxed_str());
+    let ast = match cache::load(&spc, hash, static_name) {
+        Some(ast) => ast,
+        None => {
+            let tokens = lexer::Lexer::new(content, static_name).lex()?;
+            let mut ast = parser::Parser::new(tokens).parse()?;
+            optimizer::Optimizer::optimize(&mut ast);
+            cache::store(&spc, hash, &ast);
+            ast
+        }
+    };
+    let ast = Rc::new(ast);
+    PARSED.with(|parsed| parsed.borrow_mut().insert(path.clone(), ast.clone()));
+    Ok(ast)
+}
+
+/// Execute `path` (relative to the importing file) if this is its first
+/// import, and return its top-level bindings. Later imports of the same
+/// module return the same bindings without re-running it.
+pub fn import(importer: &str, path: &str, span: &Span) -> Result<Vec<(Symbol, Value)>> {
+    let resolved = resolve(importer, path);
+    match EXECUTED.with(|executed| executed.borrow().get(&resolved).cloned()) {
+        Some(Some(bindings)) => return Ok(bindings),
+        Some(None) => error!(span, "Circular import of {}", path),
+        None => {}
+    }
+
+    let ast = match PARSED.with(|parsed| parsed.borrow().get(&resolved).cloned()) {
+        Some(ast) => ast,
+        None => load_now(&resolved, span)?,
+    };
+
+    EXECUTED.with(|executed| executed.borrow_mut().insert(resolved.clone(), None));
+    let result = run_module(&ast);
+    EXECUTED.with(|executed| match &result {
+        Ok(bindings) => {
+            executed.borrow_mut().insert(resolved.clone(), Some(bindings.clone()));
+        }
+        Err(_) => {
+            executed.borrow_mut().remove(&resolved);
+        }
+    });
+    result
+}
+
+/// Run a module's top level on a fresh tree-walking interpreter (both
+/// engines import this way — module bodies are run-once glue, not hot
+/// loops) and collect what its scope ends up holding. Functions defined
+/// here keep the module scope captured, so module-level state stays shared
+/// between them after the bindings are copied out.
+fn run_module(ast: &Rc<Ast>) -> Result<Vec<(Symbol, Value)>> {
+    let scope = Scope::new(None, false);
+    // The root block would otherwise push a scope of its own and keep the
+    // module's bindings out of reach.
+    Interpreter::new().run_block_without_new_scope(ast, ast.root(), scope.clone())?;
+    let scope = scope.borrow();
+    Ok(scope
+        .vars
+        .iter()
+        .map(|(name, value)| (*name, value.clone()))
+        .collect())
+}
@@ -0,0 +1,285 @@
+use crate::ast::{Ast, NodeId, AST};
+use crate::common::{make, Span};
+use crate::error::Result;
+use crate::interpreter::value::Value;
+
+/// Rewrites the tree after parsing, folding work the runtime would otherwise
+/// redo on every evaluation: constant arithmetic and comparisons, string
+/// concatenation, slices and indexing of literals, `len()` of a literal
+/// string, and `if`/`while` branches with constant conditions. Folding
+/// replaces nodes in the arena in place; dead subtrees simply become
+/// unreachable. Runs before the resolver, so rewritten nodes carry fresh
+/// annotation cells.
+pub struct Optimizer<'a> {
+    ast: &'a mut Ast,
+}
+
+impl<'a> Optimizer<'a> {
+    pub fn optimize(ast: &mut Ast) {
+        let root = ast.root();
+        Optimizer { ast }.opt(root);
+    }
+
+    /// The value of a literal node, if it is one.
+    fn literal(&self, node: NodeId) -> Option<Value> {
+        Some(match &self.ast[node] {
+            AST::IntegerLiteral(_, num) => Value::Integer(*num),
+            AST::FloatLiteral(_, num) => Value::Float(*num),
+            AST::BooleanLiteral(_, val) => Value::Boolean(*val),
+            AST::StringLiteral(_, string) => Value::String(make!(string.clone())),
+            _ => return None,
+        })
+    }
+
+    /// A literal node for `value`, if the value has a literal form.
+    fn unliteral(value: Value, span: &Span) -> Option<AST> {
+        Some(match value {
+            Value::Integer(num) => AST::IntegerLiteral(*span, num),
+            Value::Float(num) => AST::FloatLiteral(*span, num),
+            Value::Boolean(val) => AST::BooleanLiteral(*span, val),
+            Value::String(string) => AST::StringLiteral(*span, string.borrow().clone()),
+            Value::Slice(_) => return Self::unliteral(value.materialize(), span),
+            _ => return None,
+        })
+    }
+
+    /// Fold a binary operation over two literal operands. Returns `None`
+    /// (keep the original node) when an operand isn't a literal or the
+    /// operation would error — the runtime reports those with full context.
+    fn fold_binary(&self, span: &Span, left: NodeId, right: NodeId, op: BinaryFn) -> Option<AST> {
+        let left = self.literal(left)?;
+        let right = self.literal(right)?;
+        Self::unliteral(op(&left, &right, span).ok()?, span)
+    }
+
+    fn opt(&mut self, node: NodeId) {
+        macro_rules! binary {
+            ($method:path, $span:expr, $left:expr, $right:expr) => {{
+                let (span, left, right) = (*$span, *$left, *$right);
+                self.opt(left);
+                self.opt(right);
+                if let Some(folded) = self.fold_binary(&span, left, right, $method) {
+                    self.ast.replace(node, folded);
+                }
+            }};
+        }
+
+        match &self.ast[node] {
+            AST::Plus(span, left, right) => binary!(Value::plus, span, left, right),
+            AST::Minus(span, left, right) => binary!(Value::minus, span, left, right),
+            AST::Multiply(span, left, right) => binary!(Value::multiply, span, left, right),
+            AST::Divide(span, left, right) => {
+                let (span, left, right) = (*span, *left, *right);
+                self.opt(left);
+                self.opt(right);
+                // Never fold division by zero; let the runtime hit it.
+                if !matches!(self.literal(right), Some(Value::Integer(0))) {
+                    if let Some(folded) = self.fold_binary(&span, left, right, Value::divide) {
+                        self.ast.replace(node, folded);
+                    }
+                }
+            }
+            AST::And(span, left, right) => binary!(Value::and, span, left, right),
+            AST::Or(span, left, right) => binary!(Value::or, span, left, right),
+            AST::Equals(span, left, right) => binary!(Value::equals, span, left, right),
+            AST::NotEquals(span, left, right) => binary!(Value::not_equals, span, left, right),
+            AST::LessThan(span, left, right) => binary!(Value::less_than, span, left, right),
+            AST::GreaterThan(span, left, right) => binary!(Value::greater_than, span, left, right),
+            AST::LessEquals(span, left, right) => binary!(Value::less_equals, span, left, right),
+            AST::GreaterEquals(span, left, right) => {
+                binary!(Value::greater_equals, span, left, right)
+            }
+
+            AST::Not(span, expr) => {
+                let (span, expr) = (*span, *expr);
+                self.opt(expr);
+                if let Some(folded) = self
+                    .literal(expr)
+                    .and_then(|val| val.not(&span).ok())
+                    .and_then(|val| Self::unliteral(val, &span))
+                {
+                    self.ast.replace(node, folded);
+                }
+            }
+
+            AST::If(span, cond, body, else_body) => {
+                let (span, cond, body, else_body) = (*span, *cond, *body, *else_body);
+                self.opt(cond);
+                match self.literal(cond) {
+                    Some(Value::Boolean(true)) => {
+                        self.opt(body);
+                        self.ast.replace(node, self.ast[body].clone());
+                    }
+                    Some(Value::Boolean(false)) => match else_body {
+                        Some(else_body) => {
+                            self.opt(else_body);
+                            self.ast.replace(node, self.ast[else_body].clone());
+                        }
+                        None => self.ast.replace(node, AST::Nothing(span)),
+                    },
+                    _ => {
+                        self.opt(body);
+                        if let Some(else_body) = else_body {
+                            self.opt(else_body);
+                        }
+                    }
+                }
+            }
+
+            AST::While(span, cond, body) => {
+                let (span, cond, body) = (*span, *cond, *body);
+                self.opt(cond);
+                match self.literal(cond) {
+                    Some(Value::Boolean(false)) => self.ast.replace(node, AST::Nothing(span)),
+                    _ => self.opt(body),
+                }
+            }
+
+            AST::Index(span, lhs, index) => {
+                let (span, lhs, index) = (*span, *lhs, *index);
+                self.opt(lhs);
+                self.opt(index);
+                if let (Some(value), Some(idx)) = (self.literal(lhs), self.literal(index)) {
+                    if let Some(folded) = value
+                        .index(&idx, &span)
+                        .ok()
+                        .and_then(|folded| Self::unliteral(folded, &span))
+                    {
+                        self.ast.replace(node, folded);
+                    }
+                }
+            }
+
+            AST::Slice {
+                span,
+                lhs,
+                start,
+                end,
+                step,
+            } => {
+                let (span, lhs) = (*span, *lhs);
+                let (start, end, step) = (*start, *end, *step);
+                self.opt(lhs);
+                for part in [start, end, step].into_iter().flatten() {
+                    self.opt(part);
+                }
+                // All present indices must be literal for the fold.
+                let params = [start, end, step].map(|part| match part {
+                    Some(part) => self.literal(part).map(Some),
+                    None => Some(None),
+                });
+                if let (Some(value), [Some(start), Some(end), Some(step)]) =
+                    (self.literal(lhs), params)
+                {
+                    if let Some(folded) = value
+                        .slice(start, end, step, &span)
+                        .ok()
+                        .and_then(|folded| Self::unliteral(folded, &span))
+                    {
+                        self.ast.replace(node, folded);
+                    }
+                }
+            }
+
+            AST::Call(span, func, args) => {
+                let (span, func, args) = (*span, *func, args.clone());
+                self.opt(func);
+                for arg in &args {
+                    self.opt(*arg);
+                }
+                // len() of a literal string is a compile-time constant;
+                // built-in names can't be shadowed, so the name identifies
+                // the function.
+                if let AST::Variable(_, name, _) = &self.ast[func] {
+                    if name.as_str() == "len" && args.len() == 1 {
+                        if let AST::StringLiteral(_, string) = &self.ast[args[0]] {
+                            let folded = AST::IntegerLiteral(span, string.len() as i64);
+                            self.ast.replace(node, folded);
+                        }
+                    }
+                }
+            }
+
+            AST::Block(_, stmts, needs_scope) => {
+                // Folding can remove declarations, so reset the elision
+                // hint for the resolver to recompute.
+                needs_scope.set(true);
+                for stmt in stmts.clone() {
+                    self.opt(stmt);
+                }
+            }
+
+            AST::Function { body, .. } => {
+                let body = *body;
+                self.opt(body);
+            }
+
+            AST::Assignment(_, lhs, value) => {
+                let (lhs, value) = (*lhs, *value);
+                self.opt(lhs);
+                self.opt(value);
+            }
+            AST::VarDeclaration(_, _, value, _) => {
+                let value = *value;
+                self.opt(value);
+            }
+            AST::Return(_, expr)
+            | AST::Assert(_, expr)
+            | AST::PostIncrement(_, expr, _)
+            | AST::PreIncrement(_, expr, _) => {
+                let expr = *expr;
+                self.opt(expr);
+            }
+            AST::Range(_, start, end) => {
+                let (start, end) = (*start, *end);
+                self.opt(start);
+                self.opt(end);
+            }
+            AST::ParForEach(_, _, iterable, body) => {
+                let (iterable, body) = (*iterable, *body);
+                self.opt(iterable);
+                self.opt(body);
+            }
+            AST::ForEach(_, _, iterable, body, _) => {
+                let (iterable, body) = (*iterable, *body);
+                self.opt(iterable);
+                self.opt(body);
+            }
+            AST::For {
+                init,
+                cond,
+                step,
+                body,
+                ..
+            } => {
+                let parts = [*init, *cond, *step, Some(*body)];
+                for part in parts.into_iter().flatten() {
+                    self.opt(part);
+                }
+            }
+            AST::ArrayLiteral(_, items) => {
+                for item in items.clone() {
+                    self.opt(item);
+                }
+            }
+            AST::DictLiteral(_, pairs) => {
+                for (key, value) in pairs.clone() {
+                    self.opt(key);
+                    self.opt(value);
+                }
+            }
+
+            AST::BooleanLiteral(..)
+            | AST::IntegerLiteral(..)
+            | AST::FloatLiteral(..)
+            | AST::StringLiteral(..)
+            | AST::Variable(..)
+            | AST::Nothing(..)
+            | AST::Continue(..)
+            | AST::Break(..)
+            | AST::Import(..) => {}
+        }
+    }
+}
+
+type BinaryFn = fn(&Value, &Value, &Span) -> Result<Value>;
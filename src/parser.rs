@@ -1,11 +1,13 @@
-use crate::ast::AST;
+use crate::ast::{Ast, NodeId, AST};
+use crate::common::Span;
 use crate::error::{eof_error, parser_error as error, Result};
+use crate::symbol::Symbol;
 use crate::token::{Token, TokenKind};
-use std::rc::Rc;
 
 pub struct Parser {
     tokens: Vec<Token>,
     current_index: usize,
+    ast: Ast,
 }
 
 impl Parser {
@@ -13,6 +15,7 @@ impl Parser {
         Parser {
             tokens,
             current_index: 0,
+            ast: Ast::new(),
         }
     }
 
@@ -49,13 +52,20 @@ impl Parser {
         }
     }
 
-    pub fn parse(&mut self) -> Result<Rc<AST>> {
-        let res = self.parse_block(/*global*/ true)?;
+    pub fn parse(&mut self) -> Result<Ast> {
+        let root = self.parse_block(/*global*/ true)?;
         self.consume(TokenKind::EOF)?;
-        Ok(res)
+        let mut ast = std::mem::take(&mut self.ast);
+        ast.set_root(root);
+        Ok(ast)
     }
 
-    fn parse_block(&mut self, global: bool) -> Result<Rc<AST>> {
+    /// The span of an already-built node.
+    fn span_of(&self, id: NodeId) -> Span {
+        *self.ast[id].span()
+    }
+
+    fn parse_block(&mut self, global: bool) -> Result<NodeId> {
         let mut span = self.cur().span;
         let mut statements = vec![];
         if !global {
@@ -73,7 +83,7 @@ impl Parser {
             }
             statements.push(self.parse_statement()?);
         }
-        Ok(Rc::new(AST::Block(span, statements)))
+        Ok(self.ast.add(AST::Block(span, statements, crate::ast::needs_scope_default())))
     }
 
     fn consume_line_end(&mut self) -> Result<()> {
@@ -92,11 +102,11 @@ impl Parser {
         Ok(())
     }
 
-    fn parse_lambda(&mut self) -> Result<Rc<AST>> {
+    fn parse_lambda(&mut self) -> Result<NodeId> {
         let start = self.consume(TokenKind::Pipe)?.span;
         let mut args = vec![];
         while self.cur().kind != TokenKind::Pipe {
-            args.push(self.consume(TokenKind::Identifier)?.text);
+            args.push(Symbol::intern(self.consume(TokenKind::Identifier)?.text()));
             if self.cur().kind == TokenKind::Comma {
                 self.increment();
             }
@@ -106,25 +116,26 @@ impl Parser {
             self.increment();
             let expr = self.parse_expression()?;
             self.consume_line_end()?;
-            Rc::new(AST::Return(*expr.span(), expr))
+            self.ast.add(AST::Return(self.span_of(expr), expr))
         } else {
             self.parse_block(/*global*/ false)?
         };
-        Ok(Rc::new(AST::Function {
-            span: start.extend(body.span()),
+        Ok(self.ast.add(AST::Function {
+            span: start.extend(&self.span_of(body)),
             name: None,
             args,
             body,
+            slot: Default::default(),
         }))
     }
 
-    fn parse_function(&mut self) -> Result<(Rc<AST>, String)> {
+    fn parse_function(&mut self) -> Result<(NodeId, Symbol)> {
         let start = self.consume(TokenKind::Def)?.span;
         let name = self.consume(TokenKind::Identifier)?;
         self.consume(TokenKind::LeftParen)?;
         let mut args = vec![];
         while self.cur().kind != TokenKind::RightParen {
-            args.push(self.consume(TokenKind::Identifier)?.text);
+            args.push(Symbol::intern(self.consume(TokenKind::Identifier)?.text()));
             if self.cur().kind == TokenKind::Comma {
                 self.increment();
             }
@@ -134,23 +145,24 @@ impl Parser {
             self.increment();
             let expr = self.parse_expression()?;
             self.consume_line_end()?;
-            Rc::new(AST::Return(*expr.span(), expr))
+            self.ast.add(AST::Return(self.span_of(expr), expr))
         } else {
             self.parse_block(/*global*/ false)?
         };
         self.consume_line_end()?;
         Ok((
-            Rc::new(AST::Function {
-                span: start.extend(body.span()),
-                name: Some(name.text.clone()),
+            self.ast.add(AST::Function {
+                span: start.extend(&self.span_of(body)),
+                name: Some(Symbol::intern(name.text())),
                 args,
                 body,
+                slot: Default::default(),
             }),
-            name.text,
+            Symbol::intern(name.text()),
         ))
     }
 
-    fn parse_statement(&mut self) -> Result<Rc<AST>> {
+    fn parse_statement(&mut self) -> Result<NodeId> {
         match self.cur() {
             Token {
                 kind: TokenKind::Let,
@@ -162,10 +174,11 @@ impl Parser {
                 self.consume(TokenKind::Equals)?;
                 let expr = self.parse_expression()?;
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::VarDeclaration(
-                    span.extend(expr.span()),
-                    ident.text,
+                Ok(self.ast.add(AST::VarDeclaration(
+                    span.extend(&self.span_of(expr)),
+                    Symbol::intern(ident.text()),
                     expr,
+                    Default::default(),
                 )))
             }
             Token {
@@ -176,7 +189,7 @@ impl Parser {
                 self.increment();
                 let cond = self.parse_expression()?;
                 let body = self.parse_block(/*global*/ false)?;
-                let span = span.extend(body.span());
+                let span = span.extend(&self.span_of(body));
                 match self.cur() {
                     Token {
                         kind: TokenKind::Else,
@@ -188,14 +201,14 @@ impl Parser {
                             TokenKind::If => self.parse_statement()?,
                             _ => self.parse_block(/*global*/ false)?,
                         };
-                        Ok(Rc::new(AST::If(
-                            span.extend(else_body.span()),
+                        Ok(self.ast.add(AST::If(
+                            span.extend(&self.span_of(else_body)),
                             cond,
                             body,
                             Some(else_body),
                         )))
                     }
-                    _ => Ok(Rc::new(AST::If(span, cond, body, None))),
+                    _ => Ok(self.ast.add(AST::If(span, cond, body, None))),
                 }
             }
             Token {
@@ -212,11 +225,10 @@ impl Parser {
                 self.consume_line_end()?;
                 let (func, name) = self.parse_function()?;
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::Assignment(
-                    span.extend(deco.span()),
-                    Rc::new(AST::Variable(span.extend(deco.span()), name)),
-                    Rc::new(AST::Call(span.extend(deco.span()), deco, vec![func])),
-                )))
+                let span = span.extend(&self.span_of(deco));
+                let variable = self.ast.add(AST::Variable(span, name, Default::default()));
+                let call = self.ast.add(AST::Call(span, deco, vec![func]));
+                Ok(self.ast.add(AST::Assignment(span, variable, call)))
             }
             Token {
                 kind: TokenKind::Continue,
@@ -225,7 +237,7 @@ impl Parser {
             } => {
                 self.increment();
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::Continue(span)))
+                Ok(self.ast.add(AST::Continue(span)))
             }
             Token {
                 kind: TokenKind::Break,
@@ -234,7 +246,7 @@ impl Parser {
             } => {
                 self.increment();
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::Break(span)))
+                Ok(self.ast.add(AST::Break(span)))
             }
             Token {
                 kind: TokenKind::While,
@@ -244,7 +256,7 @@ impl Parser {
                 self.increment();
                 let cond = self.parse_expression()?;
                 let body = self.parse_block(/*global*/ false)?;
-                Ok(Rc::new(AST::While(span.extend(body.span()), cond, body)))
+                Ok(self.ast.add(AST::While(span.extend(&self.span_of(body)), cond, body)))
             }
             Token {
                 kind: TokenKind::For,
@@ -280,8 +292,8 @@ impl Parser {
                     };
                     self.consume(TokenKind::RightParen)?;
                     let body = self.parse_block(/*global*/ false)?;
-                    Ok(Rc::new(AST::For {
-                        span: span.extend(body.span()),
+                    Ok(self.ast.add(AST::For {
+                        span: span.extend(&self.span_of(body)),
                         init,
                         cond,
                         step,
@@ -293,14 +305,35 @@ impl Parser {
                     self.consume(TokenKind::In)?;
                     let expr = self.parse_expression()?;
                     let body = self.parse_block(/*global*/ false)?;
-                    Ok(Rc::new(AST::ForEach(
-                        span.extend(body.span()),
-                        ident.text,
+                    Ok(self.ast.add(AST::ForEach(
+                        span.extend(&self.span_of(body)),
+                        Symbol::intern(ident.text()),
                         expr,
                         body,
+                        Default::default(),
                     )))
                 }
             }
+            Token {
+                kind: TokenKind::Par,
+                span,
+                ..
+            } => {
+                self.increment();
+                self.parse_par_for(span)
+            }
+            Token {
+                kind: TokenKind::Import,
+                span,
+                ..
+            } => {
+                self.increment();
+                let path = self.consume(TokenKind::StringLiteral)?;
+                let span = span.extend(&path.span);
+                let path = path.text().to_string();
+                self.consume_line_end()?;
+                Ok(self.ast.add(AST::Import(span, path)))
+            }
             Token {
                 kind: TokenKind::Return,
                 span,
@@ -309,7 +342,7 @@ impl Parser {
                 self.increment();
                 let expr = self.parse_expression()?;
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::Return(span.extend(expr.span()), expr)))
+                Ok(self.ast.add(AST::Return(span.extend(&self.span_of(expr)), expr)))
             }
             Token {
                 kind: TokenKind::Assert,
@@ -318,14 +351,14 @@ impl Parser {
             } => {
                 self.increment();
                 let cond = self.parse_expression()?;
-                let span = span.extend(cond.span());
+                let span = span.extend(&self.span_of(cond));
                 if self.cur().kind == TokenKind::Comma {
                     self.increment();
                     span.extend(&self.cur().span);
                     self.consume(TokenKind::StringLiteral)?;
                 }
                 self.consume_line_end()?;
-                Ok(Rc::new(AST::Assert(span, cond)))
+                Ok(self.ast.add(AST::Assert(span, cond)))
             }
             _ => {
                 let expr = self.parse_expression();
@@ -335,11 +368,28 @@ impl Parser {
         }
     }
 
-    fn parse_expression(&mut self) -> Result<Rc<AST>> {
+    fn parse_expression(&mut self) -> Result<NodeId> {
         self.parse_assignment()
     }
 
-    fn parse_assignment(&mut self) -> Result<Rc<AST>> {
+    /// `par for x in iterable { ... }`, with the leading `par` consumed.
+    /// Parses as a statement and as an expression, so the result array can
+    /// be bound directly: `let r = par for ...`.
+    fn parse_par_for(&mut self, span: Span) -> Result<NodeId> {
+        self.consume(TokenKind::For)?;
+        let ident = self.consume(TokenKind::Identifier)?;
+        self.consume(TokenKind::In)?;
+        let expr = self.parse_expression()?;
+        let body = self.parse_block(/*global*/ false)?;
+        Ok(self.ast.add(AST::ParForEach(
+            span.extend(&self.span_of(body)),
+            Symbol::intern(ident.text()),
+            expr,
+            body,
+        )))
+    }
+
+    fn parse_assignment(&mut self) -> Result<NodeId> {
         let left = self.parse_comparison()?;
         match self.cur() {
             Token {
@@ -348,17 +398,41 @@ impl Parser {
             } => {
                 self.increment();
                 let right = self.parse_comparison()?;
-                Ok(Rc::new(AST::Assignment(
-                    left.span().extend(right.span()),
+                Ok(self.ast.add(AST::Assignment(
+                    self.span_of(left).extend(&self.span_of(right)),
                     left,
                     right,
                 )))
             }
+            Token {
+                kind:
+                    kind @ (TokenKind::PlusEquals
+                    | TokenKind::MinusEquals
+                    | TokenKind::StarEquals
+                    | TokenKind::SlashEquals),
+                ..
+            } => {
+                // `lhs op= rhs` desugars to `lhs = lhs op rhs`, reusing the
+                // target node on both sides of the assignment. Both engines
+                // key on that shared node to evaluate an indexed target's
+                // container and index only once.
+                self.increment();
+                let right = self.parse_comparison()?;
+                let span = self.span_of(left).extend(&self.span_of(right));
+                let value = self.ast.add(match kind {
+                    TokenKind::PlusEquals => AST::Plus(span, left, right),
+                    TokenKind::MinusEquals => AST::Minus(span, left, right),
+                    TokenKind::StarEquals => AST::Multiply(span, left, right),
+                    TokenKind::SlashEquals => AST::Divide(span, left, right),
+                    _ => unreachable!(),
+                });
+                Ok(self.ast.add(AST::Assignment(span, left, value)))
+            }
             _ => Ok(left),
         }
     }
 
-    fn parse_comparison(&mut self) -> Result<Rc<AST>> {
+    fn parse_comparison(&mut self) -> Result<NodeId> {
         let mut left = self.parse_logical_or()?;
         while let Token {
             kind:
@@ -376,28 +450,28 @@ impl Parser {
             let right = self.parse_logical_or()?;
             left = match op {
                 TokenKind::EqualsEquals => {
-                    Rc::new(AST::Equals(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::Equals(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
-                TokenKind::BangEquals => Rc::new(AST::NotEquals(
-                    left.span().extend(right.span()),
+                TokenKind::BangEquals => self.ast.add(AST::NotEquals(
+                    self.span_of(left).extend(&self.span_of(right)),
                     left,
                     right,
                 )),
                 TokenKind::LessThan => {
-                    Rc::new(AST::LessThan(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::LessThan(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
-                TokenKind::GreaterThan => Rc::new(AST::GreaterThan(
-                    left.span().extend(right.span()),
+                TokenKind::GreaterThan => self.ast.add(AST::GreaterThan(
+                    self.span_of(left).extend(&self.span_of(right)),
                     left,
                     right,
                 )),
-                TokenKind::LessEquals => Rc::new(AST::LessEquals(
-                    left.span().extend(right.span()),
+                TokenKind::LessEquals => self.ast.add(AST::LessEquals(
+                    self.span_of(left).extend(&self.span_of(right)),
                     left,
                     right,
                 )),
-                TokenKind::GreaterEquals => Rc::new(AST::GreaterEquals(
-                    left.span().extend(right.span()),
+                TokenKind::GreaterEquals => self.ast.add(AST::GreaterEquals(
+                    self.span_of(left).extend(&self.span_of(right)),
                     left,
                     right,
                 )),
@@ -407,7 +481,7 @@ impl Parser {
         Ok(left)
     }
 
-    fn parse_logical_or(&mut self) -> Result<Rc<AST>> {
+    fn parse_logical_or(&mut self) -> Result<NodeId> {
         let mut left = self.parse_logical_and()?;
         while let Token {
             kind: TokenKind::Or,
@@ -416,12 +490,12 @@ impl Parser {
         {
             self.increment();
             let right = self.parse_logical_and()?;
-            left = Rc::new(AST::Or(left.span().extend(right.span()), left, right));
+            left = self.ast.add(AST::Or(self.span_of(left).extend(&self.span_of(right)), left, right));
         }
         Ok(left)
     }
 
-    fn parse_logical_and(&mut self) -> Result<Rc<AST>> {
+    fn parse_logical_and(&mut self) -> Result<NodeId> {
         let mut left = self.parse_additive()?;
         while let Token {
             kind: TokenKind::And,
@@ -430,12 +504,12 @@ impl Parser {
         {
             self.increment();
             let right = self.parse_additive()?;
-            left = Rc::new(AST::And(left.span().extend(right.span()), left, right));
+            left = self.ast.add(AST::And(self.span_of(left).extend(&self.span_of(right)), left, right));
         }
         Ok(left)
     }
 
-    fn parse_additive(&mut self) -> Result<Rc<AST>> {
+    fn parse_additive(&mut self) -> Result<NodeId> {
         let mut left = self.parse_multiplicative()?;
         while let Token {
             kind: TokenKind::Plus | TokenKind::Minus,
@@ -447,10 +521,10 @@ impl Parser {
             let right = self.parse_multiplicative()?;
             left = match op {
                 TokenKind::Plus => {
-                    Rc::new(AST::Plus(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::Plus(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
                 TokenKind::Minus => {
-                    Rc::new(AST::Minus(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::Minus(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
                 _ => unreachable!(),
             }
@@ -458,7 +532,7 @@ impl Parser {
         Ok(left)
     }
 
-    fn parse_multiplicative(&mut self) -> Result<Rc<AST>> {
+    fn parse_multiplicative(&mut self) -> Result<NodeId> {
         let mut left = self.parse_prefix()?;
 
         while let Token {
@@ -471,10 +545,10 @@ impl Parser {
             let right = self.parse_prefix()?;
             left = match op {
                 TokenKind::Star => {
-                    Rc::new(AST::Multiply(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::Multiply(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
                 TokenKind::Slash => {
-                    Rc::new(AST::Divide(left.span().extend(right.span()), left, right))
+                    self.ast.add(AST::Divide(self.span_of(left).extend(&self.span_of(right)), left, right))
                 }
                 _ => unreachable!(),
             }
@@ -482,33 +556,33 @@ impl Parser {
         Ok(left)
     }
 
-    fn parse_slice_value(&mut self) -> Result<Option<Rc<AST>>> {
+    fn parse_slice_value(&mut self) -> Result<Option<NodeId>> {
         match self.cur().kind {
             TokenKind::Colon | TokenKind::RightBracket => Ok(None),
             _ => Ok(Some(self.parse_expression()?)),
         }
     }
 
-    fn parse_prefix(&mut self) -> Result<Rc<AST>> {
+    fn parse_prefix(&mut self) -> Result<NodeId> {
         match self.cur().kind {
             TokenKind::Not => {
                 let start = self.cur().span;
                 self.increment();
                 let expr = self.parse_prefix()?;
-                Ok(Rc::new(AST::Not(start.extend(expr.span()), expr)))
+                Ok(self.ast.add(AST::Not(start.extend(&self.span_of(expr)), expr)))
             }
             TokenKind::PlusPlus | TokenKind::MinusMinus => {
                 let offset = if self.cur().kind == TokenKind::PlusPlus { 1 } else { -1 };
                 let start = self.cur().span;
                 self.increment();
                 let expr = self.parse_prefix()?;
-                Ok(Rc::new(AST::PreIncrement(start.extend(expr.span()), expr, offset)))
+                Ok(self.ast.add(AST::PreIncrement(start.extend(&self.span_of(expr)), expr, offset)))
             }
             _ => self.parse_postfix(),
         }
     }
 
-    fn parse_postfix(&mut self) -> Result<Rc<AST>> {
+    fn parse_postfix(&mut self) -> Result<NodeId> {
         let mut val = self.parse_atom()?;
         loop {
             match self.cur() {
@@ -517,14 +591,14 @@ impl Parser {
                     ..
                 } => {
                     self.increment();
-                    let mut span = *val.span();
+                    let mut span = self.span_of(val);
 
                     let start = self.parse_slice_value()?;
                     if self.cur().kind == TokenKind::RightBracket {
                         span = span.extend(&self.cur().span);
                         if let Some(start) = start {
                             self.increment();
-                            val = Rc::new(AST::Index(span, val, start));
+                            val = self.ast.add(AST::Index(span, val, start));
                             continue;
                         } else {
                             error!(span, "Cannot have empty index");
@@ -537,7 +611,7 @@ impl Parser {
                     if self.cur().kind == TokenKind::RightBracket {
                         span = span.extend(&self.cur().span);
                         self.increment();
-                        val = Rc::new(AST::Slice {
+                        val = self.ast.add(AST::Slice {
                             span,
                             lhs: val,
                             start,
@@ -551,7 +625,7 @@ impl Parser {
                     let step = self.parse_slice_value()?;
                     span = span.extend(&self.cur().span);
                     self.consume(TokenKind::RightBracket)?;
-                    val = Rc::new(AST::Slice {
+                    val = self.ast.add(AST::Slice {
                         span,
                         lhs: val,
                         start,
@@ -565,7 +639,7 @@ impl Parser {
                 } => {
                     self.increment();
                     let mut args = vec![];
-                    let mut span = *val.span();
+                    let mut span = self.span_of(val);
                     loop {
                         match self.cur().kind {
                             TokenKind::RightParen => {
@@ -591,7 +665,7 @@ impl Parser {
                             }
                         }
                     }
-                    val = Rc::new(AST::Call(span, val, args));
+                    val = self.ast.add(AST::Call(span, val, args));
                 }
                 Token {
                     kind: TokenKind::DotDot,
@@ -599,7 +673,7 @@ impl Parser {
                 } => {
                     self.increment();
                     let end = self.parse_atom()?;
-                    val = Rc::new(AST::Range(val.span().extend(end.span()), val, end));
+                    val = self.ast.add(AST::Range(self.span_of(val).extend(&self.span_of(end)), val, end));
                 }
                 Token {
                     kind: TokenKind::PlusPlus | TokenKind::MinusMinus,
@@ -608,8 +682,8 @@ impl Parser {
                 } => {
                     let offset = if self.cur().kind == TokenKind::PlusPlus { 1 } else { -1 };
                     self.increment();
-                    val = Rc::new(AST::PostIncrement(
-                        val.span().extend(&span),
+                    val = self.ast.add(AST::PostIncrement(
+                        self.span_of(val).extend(&span),
                         val,
                         offset,
                     ));
@@ -620,7 +694,7 @@ impl Parser {
         Ok(val)
     }
 
-    fn parse_atom(&mut self) -> Result<Rc<AST>> {
+    fn parse_atom(&mut self) -> Result<NodeId> {
         match self.cur() {
             Token {
                 kind: TokenKind::LeftParen,
@@ -631,6 +705,14 @@ impl Parser {
                 self.consume(TokenKind::RightParen)?;
                 Ok(expr)
             }
+            Token {
+                kind: TokenKind::Par,
+                span,
+                ..
+            } => {
+                self.increment();
+                self.parse_par_for(span)
+            }
             Token {
                 kind: TokenKind::LeftBracket,
                 span,
@@ -655,94 +737,116 @@ impl Parser {
                     }
                 }
                 let end = self.consume(TokenKind::RightBracket)?.span;
-                Ok(Rc::new(AST::ArrayLiteral(span.extend(&end), arr)))
+                Ok(self.ast.add(AST::ArrayLiteral(span.extend(&end), arr)))
+            }
+            Token {
+                kind: TokenKind::LeftBrace,
+                span,
+                ..
+            } => {
+                let mut pairs = vec![];
+                self.increment();
+                while self.cur().kind != TokenKind::RightBrace {
+                    let key = self.parse_expression()?;
+                    self.consume(TokenKind::Colon)?;
+                    let value = self.parse_expression()?;
+                    pairs.push((key, value));
+                    match self.cur().kind {
+                        TokenKind::Comma => self.increment(),
+                        TokenKind::RightBrace => {}
+                        TokenKind::EOF => eof_error!(
+                            self.cur().span,
+                            "Expected `}}` or ',' but got EOF"
+                        ),
+                        _ => error!(
+                            self.cur().span,
+                            "Expected `}}` or `,` but got {:?}",
+                            self.cur().kind
+                        ),
+                    }
+                }
+                let end = self.consume(TokenKind::RightBrace)?.span;
+                Ok(self.ast.add(AST::DictLiteral(span.extend(&end), pairs)))
             }
             Token {
                 kind: TokenKind::Pipe,
                 ..
             } => self.parse_lambda(),
-            Token {
+            tok @ Token {
                 kind: TokenKind::IntegerLiteralDec,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                if let Ok(num) = text.parse::<i64>() {
-                    Ok(Rc::new(AST::IntegerLiteral(span, num)))
+                if let Some(num) = parse_int(tok.text(), 10) {
+                    Ok(self.ast.add(AST::IntegerLiteral(span, num)))
                 } else {
-                    error!(span, "Invalid integer literal: {}", text);
+                    error!(span, "Invalid integer literal: {}", tok.text());
                 }
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::IntegerLiteralBin,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                if let Ok(num) = i64::from_str_radix(&text, 2) {
-                    Ok(Rc::new(AST::IntegerLiteral(span, num)))
+                if let Some(num) = parse_int(tok.text(), 2) {
+                    Ok(self.ast.add(AST::IntegerLiteral(span, num)))
                 } else {
-                    error!(span, "Invalid integer literal: {}", text);
+                    error!(span, "Invalid integer literal: {}", tok.text());
                 }
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::IntegerLiteralOct,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                if let Ok(num) = i64::from_str_radix(&text, 8) {
-                    Ok(Rc::new(AST::IntegerLiteral(span, num)))
+                if let Some(num) = parse_int(tok.text(), 8) {
+                    Ok(self.ast.add(AST::IntegerLiteral(span, num)))
                 } else {
-                    error!(span, "Invalid integer literal: {}", text);
+                    error!(span, "Invalid integer literal: {}", tok.text());
                 }
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::IntegerLiteralHex,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                if let Ok(num) = i64::from_str_radix(&text, 16) {
-                    Ok(Rc::new(AST::IntegerLiteral(span, num)))
+                if let Some(num) = parse_int(tok.text(), 16) {
+                    Ok(self.ast.add(AST::IntegerLiteral(span, num)))
                 } else {
-                    error!(span, "Invalid integer literal: {}", text);
+                    error!(span, "Invalid integer literal: {}", tok.text());
                 }
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::FloatLiteral,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                if let Ok(num) = text.parse::<f64>() {
-                    Ok(Rc::new(AST::FloatLiteral(span, num)))
+                if let Some(num) = parse_float(tok.text()) {
+                    Ok(self.ast.add(AST::FloatLiteral(span, num)))
                 } else {
-                    error!(span, "Invalid float literal: {}", text);
+                    error!(span, "Invalid float literal: {}", tok.text());
                 }
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::StringLiteral,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                Ok(Rc::new(AST::StringLiteral(span, text)))
+                Ok(self.ast.add(AST::StringLiteral(span, tok.text().to_string())))
             }
-            Token {
+            tok @ Token {
                 kind: TokenKind::Identifier,
                 span,
-                text,
                 ..
             } => {
                 self.increment();
-                Ok(Rc::new(AST::Variable(span, text)))
+                Ok(self.ast.add(AST::Variable(span, Symbol::intern(tok.text()), Default::default())))
             }
             Token {
                 kind: TokenKind::True,
@@ -750,7 +854,7 @@ impl Parser {
                 ..
             } => {
                 self.increment();
-                Ok(Rc::new(AST::BooleanLiteral(span, true)))
+                Ok(self.ast.add(AST::BooleanLiteral(span, true)))
             }
             Token {
                 kind: TokenKind::False,
@@ -758,7 +862,7 @@ impl Parser {
                 ..
             } => {
                 self.increment();
-                Ok(Rc::new(AST::BooleanLiteral(span, false)))
+                Ok(self.ast.add(AST::BooleanLiteral(span, false)))
             }
             Token {
                 kind: TokenKind::Nothing,
@@ -766,7 +870,7 @@ impl Parser {
                 ..
             } => {
                 self.increment();
-                Ok(Rc::new(AST::Nothing(span)))
+                Ok(self.ast.add(AST::Nothing(span)))
             }
             Token {
                 kind: TokenKind::EOF,
@@ -781,3 +885,23 @@ impl Parser {
         }
     }
 }
+
+/// Numeric literal text is a raw slice of the source, so it may still
+/// contain `_` separators; strip them only when present.
+fn parse_int(text: &str, radix: u32) -> Option<i64> {
+    if text.contains('_') {
+        let cleaned: String = text.chars().filter(|c| *c != '_').collect();
+        i64::from_str_radix(&cleaned, radix).ok()
+    } else {
+        i64::from_str_radix(text, radix).ok()
+    }
+}
+
+fn parse_float(text: &str) -> Option<f64> {
+    if text.contains('_') {
+        let cleaned: String = text.chars().filter(|c| *c != '_').collect();
+        cleaned.parse().ok()
+    } else {
+        text.parse().ok()
+    }
+}
@@ -0,0 +1,173 @@
+use crate::common::Span;
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::time::Instant;
+
+/// How many dispatched nodes/ops go by between wall-clock samples. Between
+/// samples the only cost per dispatch is a counter increment, which is cheap
+/// enough to leave enabled on long-running scripts.
+const SAMPLE_INTERVAL: u32 = 1024;
+
+#[derive(Default)]
+struct LineStat {
+    samples: u64,
+    nanos: u64,
+}
+
+#[derive(Default)]
+struct FuncStat {
+    calls: u64,
+    inclusive_nanos: u64,
+    exclusive_nanos: u64,
+}
+
+/// A sampling profiler for `--profile` mode. The dispatch loops call `tick`
+/// with the span they are about to execute; every `SAMPLE_INTERVAL` ticks
+/// the elapsed time since the last sample is attributed to that span's line
+/// (exclusive) and to every function on the call stack (inclusive).
+struct Profiler {
+    enabled: bool,
+    ticks: u32,
+    last_sample: Option<Instant>,
+    lines: HashMap<(&'static str, usize), LineStat>,
+    /// Names of the currently active calls, outermost first.
+    stack: Vec<String>,
+    funcs: HashMap<String, FuncStat>,
+}
+
+impl Profiler {
+    fn sample(&mut self, span: &Span) {
+        let now = Instant::now();
+        if let Some(last) = self.last_sample {
+            let nanos = (now - last).as_nanos() as u64;
+            let line = self.lines.entry((span.0.filename, span.0.line)).or_default();
+            line.samples += 1;
+            line.nanos += nanos;
+            if let Some(top) = self.stack.last() {
+                self.funcs.entry(top.clone()).or_default().exclusive_nanos += nanos;
+            }
+            // Each function gets the delta once, however many times it
+            // appears on the stack, so recursion isn't double-counted.
+            let mut seen = Vec::with_capacity(self.stack.len());
+            for name in &self.stack {
+                if !seen.contains(&name) {
+                    seen.push(name);
+                    self.funcs.entry(name.clone()).or_default().inclusive_nanos += nanos;
+                }
+            }
+        }
+        self.last_sample = Some(now);
+    }
+}
+
+thread_local! {
+    static PROFILER: RefCell<Profiler> = RefCell::new(Profiler {
+        enabled: false,
+        ticks: 0,
+        last_sample: None,
+        lines: HashMap::new(),
+        stack: vec!["<main>".to_string()],
+        funcs: HashMap::new(),
+    });
+}
+
+/// Turn profiling on for this thread; the engines check this once at startup.
+pub fn enable() {
+    PROFILER.with(|p| {
+        let mut p = p.borrow_mut();
+        p.enabled = true;
+        p.last_sample = Some(Instant::now());
+        p.funcs.entry("<main>".to_string()).or_default().calls = 1;
+    });
+}
+
+pub fn enabled() -> bool {
+    PROFILER.with(|p| p.borrow().enabled)
+}
+
+/// Called by the dispatch loops once per executed node/op.
+pub fn tick(span: &Span) {
+    PROFILER.with(|p| {
+        let mut p = p.borrow_mut();
+        p.ticks += 1;
+        if p.ticks >= SAMPLE_INTERVAL {
+            p.ticks = 0;
+            p.sample(span);
+        }
+    });
+}
+
+pub fn enter_function(name: String) {
+    PROFILER.with(|p| {
+        let mut p = p.borrow_mut();
+        p.funcs.entry(name.clone()).or_default().calls += 1;
+        p.stack.push(name);
+    });
+}
+
+pub fn leave_function() {
+    PROFILER.with(|p| {
+        let mut p = p.borrow_mut();
+        // Keep the synthetic top-level entry.
+        if p.stack.len() > 1 {
+            p.stack.pop();
+        }
+    });
+}
+
+fn secs(nanos: u64) -> f64 {
+    nanos as f64 / 1e9
+}
+
+/// Print the ranked hot-spot report to stderr, so it never mixes with
+/// script output on stdout.
+pub fn report() {
+    PROFILER.with(|p| {
+        let p = p.borrow();
+        let total: u64 = p.lines.values().map(|stat| stat.nanos).sum();
+        let samples: u64 = p.lines.values().map(|stat| stat.samples).sum();
+        if total == 0 {
+            eprintln!("[profile] no samples collected (script too short?)");
+            return;
+        }
+
+        eprintln!();
+        eprintln!(
+            "[profile] {} samples over {:.3}s (1 per {} dispatches)",
+            samples,
+            secs(total),
+            SAMPLE_INTERVAL
+        );
+
+        let mut lines: Vec<_> = p.lines.iter().collect();
+        lines.sort_by_key(|(_, stat)| std::cmp::Reverse(stat.nanos));
+        eprintln!();
+        eprintln!("Hot lines:");
+        eprintln!("  {:>6}  {:>8}  {:>8}  location", "%", "time", "samples");
+        for ((filename, line), stat) in lines.iter().take(15) {
+            eprintln!(
+                "  {:>5.1}%  {:>7.3}s  {:>8}  {}:{}",
+                100.0 * stat.nanos as f64 / total as f64,
+                secs(stat.nanos),
+                stat.samples,
+                filename,
+                line
+            );
+        }
+
+        let mut funcs: Vec<_> = p.funcs.iter().collect();
+        funcs.sort_by_key(|(_, stat)| std::cmp::Reverse(stat.inclusive_nanos));
+        eprintln!();
+        eprintln!("Hot functions:");
+        eprintln!("  {:>8}  {:>8}  {:>8}  name", "incl", "excl", "calls");
+        for (name, stat) in funcs.iter().take(15) {
+            eprintln!(
+                "  {:>7.3}s  {:>7.3}s  {:>8}  {}",
+                secs(stat.inclusive_nanos),
+                secs(stat.exclusive_nanos),
+                stat.calls,
+                name
+            );
+        }
+    });
+}
@@ -1,8 +1,9 @@
-use crate::ast::AST;
+use crate::ast::Ast;
 use crate::common::Ref;
 use crate::error::{Error, Result, ErrorKind};
 use crate::interpreter::value::Value;
 use crate::interpreter::{Interpreter, Scope};
+use crate::token::{Token, TokenKind};
 use std::io::Write;
 use std::rc::Rc;
 
@@ -22,31 +23,71 @@ impl Repl {
     }
 
     fn run_once(&mut self) -> Result<()> {
-        let mut input = String::new();
+        // Tokens accumulated across continuation lines; each new line is
+        // lexed on its own and spliced onto the stream, so a pasted N-line
+        // construct costs O(N) lexing instead of re-lexing the whole buffer
+        // after every line.
+        let mut tokens: Vec<Token> = vec![];
+        // Net `(`/`[`/`{` nesting. While it's positive the construct can't
+        // be complete, so we don't even attempt a parse.
+        let mut depth = 0i64;
+        let mut line = 1;
         let ast = loop {
             let mut temp = String::new();
-            print!("{}", if input.is_empty() { ">>> " } else { "... " });
+            print!("{}", if tokens.is_empty() { ">>> " } else { "... " });
             std::io::stdout().flush().expect("Failed to flush stdout");
-            std::io::stdin()
+            let bytes = std::io::stdin()
                 .read_line(&mut temp)
                 .expect("Failed to read line");
+            if bytes == 0 {
+                // EOF (ctrl-D): leave instead of spinning on empty reads.
+                println!();
+                std::process::exit(0);
+            }
             if temp.trim().is_empty() {
-                if input.trim().is_empty() {
+                if tokens.is_empty() {
                     return Ok(());
                 }
                 continue;
             }
 
-            input.push_str(&temp);
-            match self.try_parse(input.clone()) {
+            let mut lexer = crate::lexer::Lexer::new_starting_at(temp, "<repl>", line);
+            line += 1;
+            let new_tokens = lexer.lex()?;
+            for token in &new_tokens {
+                match token.kind {
+                    TokenKind::LeftParen | TokenKind::LeftBracket | TokenKind::LeftBrace => {
+                        depth += 1
+                    }
+                    TokenKind::RightParen | TokenKind::RightBracket | TokenKind::RightBrace => {
+                        depth -= 1
+                    }
+                    _ => {}
+                }
+            }
+            // Drop the previous line's EOF token; the new line brings its own.
+            tokens.pop();
+            tokens.extend(new_tokens);
+
+            if depth > 0 {
+                continue;
+            }
+            match self.try_parse(tokens.clone()) {
                 Ok(ast) => break ast,
                 Err(Error{kind: ErrorKind::UnexpectedEOF, ..}) => {}
                 Err(err) => return Err(err),
             }
         };
+        let root = ast.root();
         let val = self
             .interpreter
-            .run_block_without_new_scope(&ast, self.global_scope.clone())?;
+            .run_block_without_new_scope(&ast, root, self.global_scope.clone());
+        // Buffered builtin output must appear before the result or any error.
+        crate::interpreter::flush_output();
+        // Named closures cycle with their captured scope; reclaim whatever
+        // this evaluation orphaned so a resident REPL has stable memory.
+        crate::interpreter::gc::collect();
+        let val = val?;
         match &val {
             Value::Nothing => {}
             _ => println!("{}", val.repr()),
@@ -54,11 +95,9 @@ impl Repl {
         Ok(())
     }
 
-    fn try_parse(&self, input: String) -> Result<Rc<AST>> {
-        let mut lex = crate::lexer::Lexer::new(input, "<repl>");
-        let tokens = lex.lex()?;
+    fn try_parse(&self, tokens: Vec<Token>) -> Result<Rc<Ast>> {
         let mut parser = crate::parser::Parser::new(tokens);
-        parser.parse()
+        Ok(Rc::new(parser.parse()?))
     }
 
     pub fn run(&mut self) {
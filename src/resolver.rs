@@ -0,0 +1,260 @@
+use crate::ast::{Ast, NodeId, AST};
+use crate::symbol::Symbol;
+use std::collections::{HashMap, HashSet};
+
+/// Static mirror of one runtime scope: the slot assigned to each name
+/// declared in it.
+struct ScopeInfo {
+    names: HashMap<Symbol, u16>,
+}
+
+/// Assigns each variable reference a (scope-depth, slot-index) pair so the
+/// interpreter can read it by indexing into a `Vec<Value>` frame instead of
+/// hashing the name at every level of the scope chain.
+///
+/// The pass mirrors exactly the scopes the interpreter creates at runtime:
+/// one per block, one for each loop variable, and one for function arguments.
+/// Function bodies are resolved at the end of their enclosing block so that
+/// forward references to later declarations keep working. Names that can't be
+/// resolved statically (built-ins, genuinely unknown variables) are left
+/// unannotated and fall back to the dynamic lookup path.
+pub struct Resolver<'a> {
+    ast: &'a Ast,
+    scopes: Vec<ScopeInfo>,
+    /// Functions encountered per open scope, resolved when the scope closes.
+    pending: Vec<Vec<NodeId>>,
+    builtins: HashSet<Symbol>,
+}
+
+impl<'a> Resolver<'a> {
+    pub fn resolve(ast: &Ast) {
+        let mut resolver = Resolver {
+            ast,
+            scopes: vec![],
+            pending: vec![],
+            builtins: crate::interpreter::default_builtins()
+                .keys()
+                .map(|name| Symbol::intern(name))
+                .collect(),
+        };
+        resolver.walk(ast.root());
+    }
+
+    fn push_scope(&mut self) {
+        self.scopes.push(ScopeInfo {
+            names: HashMap::new(),
+        });
+        self.pending.push(vec![]);
+    }
+
+    fn pop_scope(&mut self) {
+        // Resolve functions defined in this scope now that all of its
+        // declarations are known.
+        let pending = self.pending.pop().unwrap();
+        for func in pending {
+            self.resolve_function(func);
+        }
+        self.scopes.pop();
+    }
+
+    /// Resolve a function's body in a fresh scope holding its arguments.
+    fn resolve_function(&mut self, func: NodeId) {
+        if let AST::Function { args, body, .. } = &self.ast[func] {
+            self.push_scope();
+            for arg in args.clone() {
+                self.declare(arg);
+            }
+            self.walk(*body);
+            self.pop_scope();
+        }
+    }
+
+    fn declare(&mut self, name: Symbol) -> u16 {
+        let scope = self.scopes.last_mut().expect("no open scope");
+        if let Some(slot) = scope.names.get(&name) {
+            // Re-declaration in the same scope overwrites the binding.
+            return *slot;
+        }
+        let slot = scope.names.len() as u16;
+        scope.names.insert(name, slot);
+        slot
+    }
+
+    fn lookup(&self, name: Symbol) -> Option<(u16, u16)> {
+        for (depth, scope) in self.scopes.iter().rev().enumerate() {
+            if let Some(slot) = scope.names.get(&name) {
+                return Some((depth as u16, *slot));
+            }
+        }
+        None
+    }
+
+    fn walk(&mut self, node: NodeId) {
+        match &self.ast[node] {
+            AST::Block(_, stmts, needs_scope) => {
+                // A block that declares nothing can run directly in its
+                // parent scope, saving an allocation per entry.
+                let declares = stmts.iter().any(|stmt| {
+                    matches!(
+                        self.ast[*stmt],
+                        AST::VarDeclaration(..) | AST::Function { name: Some(_), .. }
+                    )
+                });
+                if declares {
+                    self.push_scope();
+                    for stmt in stmts {
+                        self.walk(*stmt);
+                    }
+                    self.pop_scope();
+                } else {
+                    needs_scope.set(false);
+                    for stmt in stmts {
+                        self.walk(*stmt);
+                    }
+                }
+            }
+
+            AST::Variable(_, name, slot) => {
+                if !self.builtins.contains(name) {
+                    slot.set(self.lookup(*name));
+                }
+            }
+
+            AST::VarDeclaration(_, name, value, slot) => {
+                // The value is evaluated before the name is bound, so
+                // `let x = x` still refers to the outer `x`.
+                self.walk(*value);
+                slot.set(Some(self.declare(*name)));
+            }
+
+            AST::Function { name, slot, .. } => {
+                if let Some(name) = name {
+                    slot.set(Some(self.declare(*name)));
+                }
+                // Defer the body until the enclosing block is fully
+                // declared. An anonymous function in a declaration-free
+                // (elided) root block has no open scope to wait on; its
+                // body can't forward-reference anything, so resolve it on
+                // the spot.
+                match self.pending.last_mut() {
+                    Some(pending) => pending.push(node),
+                    None => self.resolve_function(node),
+                }
+            }
+
+            // The body executes in worker threads against a freshly decoded
+            // copy of the arena, so only the iterable resolves here.
+            AST::ParForEach(_, _, iter, _) => self.walk(*iter),
+
+            AST::ForEach(_, loop_var, iter, body, slot) => {
+                self.walk(*iter);
+                self.push_scope();
+                slot.set(Some(self.declare(*loop_var)));
+                self.walk(*body);
+                self.pop_scope();
+            }
+
+            AST::For {
+                init,
+                cond,
+                step,
+                body,
+                ..
+            } => {
+                self.push_scope();
+                if let Some(init) = init {
+                    self.walk(*init);
+                }
+                if let Some(cond) = cond {
+                    self.walk(*cond);
+                }
+                if let Some(step) = step {
+                    self.walk(*step);
+                }
+                self.walk(*body);
+                self.pop_scope();
+            }
+
+            AST::Slice {
+                lhs,
+                start,
+                end,
+                step,
+                ..
+            } => {
+                self.walk(*lhs);
+                for part in [start, end, step].into_iter().flatten() {
+                    self.walk(*part);
+                }
+            }
+
+            AST::Call(_, func, args) => {
+                self.walk(*func);
+                for arg in args {
+                    self.walk(*arg);
+                }
+            }
+
+            AST::ArrayLiteral(_, items) => {
+                for item in items {
+                    self.walk(*item);
+                }
+            }
+            AST::DictLiteral(_, pairs) => {
+                for (key, value) in pairs {
+                    self.walk(*key);
+                    self.walk(*value);
+                }
+            }
+
+            AST::And(_, left, right)
+            | AST::Or(_, left, right)
+            | AST::Plus(_, left, right)
+            | AST::Minus(_, left, right)
+            | AST::Multiply(_, left, right)
+            | AST::Divide(_, left, right)
+            | AST::Equals(_, left, right)
+            | AST::NotEquals(_, left, right)
+            | AST::LessThan(_, left, right)
+            | AST::GreaterThan(_, left, right)
+            | AST::LessEquals(_, left, right)
+            | AST::GreaterEquals(_, left, right)
+            | AST::Index(_, left, right)
+            | AST::Range(_, left, right)
+            | AST::While(_, left, right) => {
+                self.walk(*left);
+                self.walk(*right);
+            }
+
+            AST::Assignment(_, left, right) => {
+                // The value is evaluated before the target is bound at
+                // runtime; decorators rely on this ordering.
+                self.walk(*right);
+                self.walk(*left);
+            }
+
+            AST::If(_, cond, body, else_body) => {
+                self.walk(*cond);
+                self.walk(*body);
+                if let Some(else_body) = else_body {
+                    self.walk(*else_body);
+                }
+            }
+
+            AST::Not(_, expr)
+            | AST::Assert(_, expr)
+            | AST::Return(_, expr)
+            | AST::PostIncrement(_, expr, _)
+            | AST::PreIncrement(_, expr, _) => self.walk(*expr),
+
+            AST::BooleanLiteral(..)
+            | AST::IntegerLiteral(..)
+            | AST::FloatLiteral(..)
+            | AST::StringLiteral(..)
+            | AST::Nothing(..)
+            | AST::Continue(..)
+            | AST::Break(..)
+            | AST::Import(..) => {}
+        }
+    }
+}
@@ -0,0 +1,47 @@
+use std::cell::RefCell;
+use std::collections::HashMap;
+
+/// An interned identifier name. Equal symbols always mean equal names, so
+/// variable binding and lookup hash and compare a `u32` instead of a string.
+#[derive(Debug, Clone, Copy, PartialEq, Eq, Hash)]
+pub struct Symbol(u32);
+
+/// The set of distinct identifiers in a program is small and fixed, so the
+/// interner leaks each name once to hand out `&'static str`s. The engine is
+/// single-threaded (everything runs on the interpreter thread), hence
+/// thread-local rather than locked.
+#[derive(Default)]
+struct Interner {
+    names: Vec<&'static str>,
+    ids: HashMap<&'static str, Symbol>,
+}
+
+thread_local! {
+    static INTERNER: RefCell<Interner> = RefCell::new(Interner::default());
+}
+
+impl Symbol {
+    pub fn intern(name: &str) -> Symbol {
+        INTERNER.with(|interner| {
+            let mut interner = interner.borrow_mut();
+            if let Some(sym) = interner.ids.get(name) {
+                return *sym;
+            }
+            let name: &'static str = Box::leak(name.to_string().into_boxed_str());
+            let sym = Symbol(interner.names.len() as u32);
+            interner.names.push(name);
+            interner.ids.insert(name, sym);
+            sym
+        })
+    }
+
+    pub fn as_str(self) -> &'static str {
+        INTERNER.with(|interner| interner.borrow().names[self.0 as usize])
+    }
+}
+
+impl std::fmt::Display for Symbol {
+    fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> std::fmt::Result {
+        f.write_str(self.as_str())
+    }
+}
@@ -1,5 +1,6 @@
 
 use crate::common::Span;
+use std::rc::Rc;
 
 #[allow(clippy::upper_case_acronyms)]
 #[derive(Debug, Clone, Eq, PartialEq)]
@@ -24,6 +25,7 @@ pub enum TokenKind {
     For,
     Identifier,
     If,
+    Import,
     In,
     IntegerLiteralBin,
     IntegerLiteralOct,
@@ -37,21 +39,26 @@ pub enum TokenKind {
     Let,
     Minus,
     MinusMinus,
+    MinusEquals,
     Not,
     GreaterThan,
     GreaterEquals,
     Nothing,
     Or,
+    Par,
     Pipe,
     Plus,
     PlusPlus,
+    PlusEquals,
     Return,
     RightBrace,
     RightBracket,
     RightParen,
     SemiColon,
     Slash,
+    SlashEquals,
     Star,
+    StarEquals,
     StringLiteral,
     True,
     While,
@@ -59,37 +66,45 @@ pub enum TokenKind {
     Break,
 }
 
+/// Tokens don't own their text: they share the source buffer and carry a
+/// byte range into it, so lexing performs no per-token allocations and
+/// cloning a token is a refcount bump.
 #[derive(Debug, Clone)]
 pub struct Token {
     pub kind: TokenKind,
     pub span: Span,
-    pub text: String,
+    source: Rc<str>,
+    range: (usize, usize),
     pub newline_before: bool,
 }
 
 impl Token {
-    pub fn new(kind: TokenKind, span: Span, text: String) -> Token {
+    pub fn new(kind: TokenKind, span: Span, source: Rc<str>, range: (usize, usize)) -> Token {
         Token {
             kind,
             span,
-            text,
+            source,
+            range,
             newline_before: false,
         }
     }
 
-    pub fn from_str(text: String, span: Span) -> Token {
+    /// An identifier-shaped token: a keyword if the text is one.
+    pub fn from_str(source: Rc<str>, range: (usize, usize), span: Span) -> Token {
         Token {
-            kind: match text.as_ref() {
+            kind: match &source[range.0..range.1] {
                 "and" => TokenKind::And,
                 "assert" => TokenKind::Assert,
                 "def" => TokenKind::Def,
                 "else" => TokenKind::Else,
                 "false" => TokenKind::False,
                 "if" => TokenKind::If,
+                "import" => TokenKind::Import,
                 "let" => TokenKind::Let,
                 "not" => TokenKind::Not,
                 "nothing" => TokenKind::Nothing,
                 "or" => TokenKind::Or,
+                "par" => TokenKind::Par,
                 "return" => TokenKind::Return,
                 "true" => TokenKind::True,
                 "while" => TokenKind::While,
@@ -100,17 +115,22 @@ impl Token {
                 _ => TokenKind::Identifier,
             },
             span,
-            text,
+            source,
+            range,
             newline_before: false,
         }
     }
+
+    pub fn text(&self) -> &str {
+        &self.source[self.range.0..self.range.1]
+    }
 }
 
 impl std::fmt::Display for Token {
     fn fmt(&self, f: &mut std::fmt::Formatter<'_>) -> Result<(), std::fmt::Error> {
         write!(f, "{:?}", self.kind)?;
-        if !self.text.is_empty() {
-            write!(f, "({})", self.text)?;
+        if !self.text().is_empty() {
+            write!(f, "({})", self.text())?;
         }
         Ok(())
     }
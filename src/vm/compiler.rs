@@ -0,0 +1,605 @@
+use crate::ast::{Ast, NodeId, AST};
+use crate::symbol::Symbol;
+use crate::common::{make, Span};
+use crate::error::{runtime_error as error, Result};
+use crate::interpreter::value::Value;
+use crate::vm::{BinOp, Chunk, FunctionProto, Op};
+use std::collections::HashMap;
+use std::rc::Rc;
+
+struct LoopContext {
+    /// Scope depth at loop entry; `break`/`continue` pop back down to this.
+    depth: usize,
+    /// `Jump` instructions to patch to the end of the loop.
+    break_patches: Vec<usize>,
+    /// `Jump` instructions to patch to the continue point (known target if `Some`).
+    continue_target: Option<usize>,
+    continue_patches: Vec<usize>,
+}
+
+/// A constant pool entry's identity, for deduplication. Floats are keyed
+/// by their bits, so distinct NaNs (or 0.0 vs -0.0) stay distinct entries.
+#[derive(PartialEq, Eq, Hash)]
+enum ConstKey {
+    Integer(i64),
+    Float(u64),
+    Boolean(bool),
+    String(String),
+    BuiltIn(&'static str),
+    Nothing,
+}
+
+impl ConstKey {
+    fn of(value: &Value) -> Option<ConstKey> {
+        Some(match value {
+            Value::Integer(num) => ConstKey::Integer(*num),
+            Value::Float(num) => ConstKey::Float(num.to_bits()),
+            Value::Boolean(flag) => ConstKey::Boolean(*flag),
+            Value::String(string) => ConstKey::String(string.borrow().clone()),
+            Value::BuiltInFunction(builtin) => ConstKey::BuiltIn(builtin.name),
+            Value::Nothing => ConstKey::Nothing,
+            _ => return None,
+        })
+    }
+}
+
+pub struct Compiler<'a> {
+    ast: &'a Rc<Ast>,
+    chunk: Chunk,
+    constants: HashMap<ConstKey, u16>,
+    names: HashMap<Symbol, u16>,
+    builtins: HashMap<&'static str, &'static crate::interpreter::BuiltIn>,
+    loops: Vec<LoopContext>,
+    depth: usize,
+    in_function: bool,
+}
+
+impl<'a> Compiler<'a> {
+    fn new(ast: &'a Rc<Ast>, in_function: bool) -> Compiler<'a> {
+        Compiler {
+            ast,
+            chunk: Chunk::new(ast.clone()),
+            constants: HashMap::new(),
+            names: HashMap::new(),
+            builtins: crate::interpreter::default_builtins(),
+            loops: vec![],
+            depth: 0,
+            in_function,
+        }
+    }
+
+    pub fn compile_program(ast: &Rc<Ast>) -> Result<Chunk> {
+        let mut compiler = Compiler::new(ast, false);
+        compiler.compile(ast.root())?;
+        Ok(compiler.chunk)
+    }
+
+    pub fn compile_function(ast: &Rc<Ast>, body: NodeId) -> Result<Chunk> {
+        let mut compiler = Compiler::new(ast, true);
+        compiler.compile(body)?;
+        // Implicit `return nothing` for functions that fall off the end.
+        let span = *ast[body].span();
+        compiler.emit_constant(Value::Nothing, &span)?;
+        compiler.emit(Op::Return, &span);
+        Ok(compiler.chunk)
+    }
+
+    fn emit(&mut self, op: Op, span: &Span) -> usize {
+        self.chunk.code.push(op);
+        self.chunk.spans.push(*span);
+        self.chunk.caches.push(std::cell::Cell::new(crate::vm::InlineCache::Unseen));
+        self.chunk.code.len() - 1
+    }
+
+    /// Add `value` to the constant pool (reusing an existing identical
+    /// entry) and emit a load of it. Machine-generated scripts can carry
+    /// enormous literal tables, so running out of the u16 index space is a
+    /// compile error, not a silent wrap.
+    fn emit_constant(&mut self, value: Value, span: &Span) -> Result<()> {
+        let idx = match ConstKey::of(&value) {
+            Some(key) => match self.constants.get(&key) {
+                Some(idx) => *idx,
+                None => {
+                    let idx = self.add_constant(value, span)?;
+                    self.constants.insert(key, idx);
+                    idx
+                }
+            },
+            None => self.add_constant(value, span)?,
+        };
+        self.emit(Op::Constant(idx), span);
+        Ok(())
+    }
+
+    fn add_constant(&mut self, value: Value, span: &Span) -> Result<u16> {
+        if self.chunk.constants.len() > u16::MAX as usize {
+            error!(span, "Too many distinct constants in one compilation unit");
+        }
+        let idx = self.chunk.constants.len() as u16;
+        self.chunk.constants.push(value);
+        Ok(idx)
+    }
+
+    fn name(&mut self, name: Symbol, span: &Span) -> Result<u16> {
+        if let Some(idx) = self.names.get(&name) {
+            return Ok(*idx);
+        }
+        if self.chunk.names.len() > u16::MAX as usize {
+            error!(span, "Too many distinct names in one compilation unit");
+        }
+        let idx = self.chunk.names.len() as u16;
+        self.chunk.names.push(name);
+        self.names.insert(name, idx);
+        Ok(idx)
+    }
+
+    fn here(&self) -> usize {
+        self.chunk.code.len()
+    }
+
+    fn patch_jump(&mut self, at: usize) {
+        let target = self.here();
+        match &mut self.chunk.code[at] {
+            Op::Jump(t) | Op::JumpIfFalse(t) | Op::IterNext(t) => *t = target,
+            op => unreachable!("patching non-jump op {:?}", op),
+        }
+    }
+
+    /// Pop block scopes entered since the enclosing loop started, for
+    /// `break`/`continue` jumping out of nested blocks.
+    fn emit_scope_unwind(&mut self, span: &Span) {
+        let loop_depth = self.loops.last().expect("not in a loop").depth;
+        for _ in loop_depth..self.depth {
+            self.emit(Op::PopScope, span);
+        }
+    }
+
+    /// Every node compiles to code leaving exactly one value on the stack;
+    /// statement position pops it.
+    fn compile(&mut self, node: NodeId) -> Result<()> {
+        let ast: &Ast = self.ast;
+        match &ast[node] {
+            AST::BooleanLiteral(span, value) => {
+                self.emit_constant(Value::Boolean(*value), span)?;
+            }
+            AST::IntegerLiteral(span, num) => {
+                self.emit_constant(Value::Integer(*num), span)?;
+            }
+            AST::FloatLiteral(span, num) => {
+                self.emit_constant(Value::Float(*num), span)?;
+            }
+            AST::StringLiteral(span, string) => {
+                self.emit_constant(Value::String(make!(string.clone())), span)?;
+            }
+            AST::Nothing(span) => {
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Plus(span, left, right) => self.compile_binop(BinOp::Add, *left, *right, span)?,
+            AST::Minus(span, left, right) => self.compile_binop(BinOp::Sub, *left, *right, span)?,
+            AST::Multiply(span, left, right) => self.compile_binop(BinOp::Mul, *left, *right, span)?,
+            AST::Divide(span, left, right) => self.compile_binop(BinOp::Div, *left, *right, span)?,
+            AST::And(span, left, right) => self.compile_binop(BinOp::And, *left, *right, span)?,
+            AST::Or(span, left, right) => self.compile_binop(BinOp::Or, *left, *right, span)?,
+            AST::Equals(span, left, right) => self.compile_binop(BinOp::Eq, *left, *right, span)?,
+            AST::NotEquals(span, left, right) => self.compile_binop(BinOp::Ne, *left, *right, span)?,
+            AST::LessThan(span, left, right) => self.compile_binop(BinOp::Lt, *left, *right, span)?,
+            AST::GreaterThan(span, left, right) => {
+                self.compile_binop(BinOp::Gt, *left, *right, span)?
+            }
+            AST::LessEquals(span, left, right) => {
+                self.compile_binop(BinOp::Le, *left, *right, span)?
+            }
+            AST::GreaterEquals(span, left, right) => {
+                self.compile_binop(BinOp::Ge, *left, *right, span)?
+            }
+
+            AST::Not(span, expr) => {
+                self.compile(*expr)?;
+                self.emit(Op::Not, span);
+            }
+
+            AST::Block(span, stmts, _) => {
+                // Blocks that declare nothing run directly in the enclosing
+                // scope.
+                let declares = stmts.iter().any(|stmt| {
+                    matches!(
+                        ast[*stmt],
+                        AST::VarDeclaration(..) | AST::Function { name: Some(_), .. }
+                    )
+                });
+                if declares {
+                    self.emit(Op::PushScope, span);
+                    self.depth += 1;
+                }
+                for stmt in stmts {
+                    self.compile(*stmt)?;
+                    let span = *ast[*stmt].span();
+                    self.emit(Op::Pop, &span);
+                }
+                if declares {
+                    self.depth -= 1;
+                    self.emit(Op::PopScope, span);
+                }
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Variable(span, name, _) => {
+                // Built-ins can't be shadowed (`Declare`/`SetVar` reject their
+                // names), so a reference to one is folded into a constant here
+                // rather than looked up by name on every `GetVar`.
+                if let Some(builtin) = self.builtins.get(name.as_str()) {
+                    self.emit_constant(Value::BuiltInFunction(builtin), span)?;
+                } else {
+                    let idx = self.name(*name, span)?;
+                    self.emit(Op::GetVar(idx), span);
+                }
+            }
+
+            AST::VarDeclaration(span, name, value, _) => {
+                self.compile(*value)?;
+                self.emit(Op::Dup, span);
+                let idx = self.name(*name, span)?;
+                self.emit(Op::Declare(idx), span);
+            }
+
+            AST::Assignment(span, lhs, value) => {
+                // `s = s + expr` appends into the accumulator when unaliased;
+                // see `Value::append`.
+                if let (AST::Variable(_, target, _), AST::Plus(_, plus_lhs, plus_rhs)) =
+                    (&ast[*lhs], &ast[*value])
+                {
+                    if let AST::Variable(_, source, _) = &ast[*plus_lhs] {
+                        if target == source && !self.builtins.contains_key(target.as_str()) {
+                            // Snapshot the accumulator before the addend runs,
+                            // matching the interpreter's left-then-right order
+                            // when the addend itself mutates the variable.
+                            let idx = self.name(*target, span)?;
+                            self.emit(Op::GetVar(idx), span);
+                            self.compile(*plus_rhs)?;
+                            self.emit(Op::Append(idx), span);
+                            return Ok(());
+                        }
+                    }
+                }
+                // `arr[i] op= rhs` desugars with the target node shared by
+                // both sides; compile the container and index once and
+                // read-modify-write through them.
+                if let AST::Index(_, container, index) = &ast[*lhs] {
+                    let rmw = match &ast[*value] {
+                        AST::Plus(_, l, r) if l == lhs => Some((BinOp::Add, *r)),
+                        AST::Minus(_, l, r) if l == lhs => Some((BinOp::Sub, *r)),
+                        AST::Multiply(_, l, r) if l == lhs => Some((BinOp::Mul, *r)),
+                        AST::Divide(_, l, r) if l == lhs => Some((BinOp::Div, *r)),
+                        _ => None,
+                    };
+                    if let Some((binop, rhs)) = rmw {
+                        let (container, index) = (*container, *index);
+                        self.compile(container)?;
+                        self.compile(index)?;
+                        self.emit(Op::Dup2, span);
+                        self.emit(Op::Index, span);
+                        self.compile(rhs)?;
+                        self.emit(Op::BinaryOp(binop), span);
+                        self.emit(Op::StoreIndex, span);
+                        return Ok(());
+                    }
+                }
+                self.compile(*value)?;
+                self.emit(Op::Dup, span);
+                self.compile_assign_target(*lhs, span)?;
+            }
+
+            AST::If(span, cond, body, else_body) => {
+                self.compile(*cond)?;
+                let to_else = self.emit(Op::JumpIfFalse(0), span);
+                self.compile(*body)?;
+                let to_end = self.emit(Op::Jump(0), span);
+                self.patch_jump(to_else);
+                match else_body {
+                    Some(else_body) => self.compile(*else_body)?,
+                    None => self.emit_constant(Value::Nothing, span)?,
+                }
+                self.patch_jump(to_end);
+            }
+
+            AST::While(span, cond, body) => {
+                let start = self.here();
+                self.loops.push(LoopContext {
+                    depth: self.depth,
+                    break_patches: vec![],
+                    continue_target: Some(start),
+                    continue_patches: vec![],
+                });
+                self.compile(*cond)?;
+                let to_end = self.emit(Op::JumpIfFalse(0), span);
+                self.compile(*body)?;
+                self.emit(Op::Pop, span);
+                self.emit(Op::Jump(start), span);
+                self.patch_jump(to_end);
+                let ctx = self.loops.pop().unwrap();
+                for at in ctx.break_patches {
+                    self.patch_jump(at);
+                }
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::ForEach(span, loop_var, iter, body, _) => {
+                self.compile(*iter)?;
+                self.emit(Op::GetIter, span);
+                // One scope for the whole loop; the loop variable is rebound
+                // in place each iteration.
+                self.emit(Op::PushScope, span);
+                self.depth += 1;
+                let start = self.here();
+                let next = self.emit(Op::IterNext(0), span);
+                self.loops.push(LoopContext {
+                    depth: self.depth,
+                    break_patches: vec![],
+                    continue_target: Some(start),
+                    continue_patches: vec![],
+                });
+                let idx = self.name(*loop_var, span)?;
+                self.emit(Op::Declare(idx), span);
+                self.compile(*body)?;
+                self.emit(Op::Pop, span);
+                self.emit(Op::Jump(start), span);
+                self.patch_jump(next);
+                let ctx = self.loops.pop().unwrap();
+                for at in ctx.break_patches {
+                    self.patch_jump(at);
+                }
+                self.depth -= 1;
+                self.emit(Op::PopScope, span);
+                self.emit(Op::Pop, span); // the iterator
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::For {
+                span,
+                init,
+                cond,
+                step,
+                body,
+            } => {
+                self.emit(Op::PushScope, span);
+                self.depth += 1;
+                if let Some(init) = init {
+                    self.compile(*init)?;
+                    self.emit(Op::Pop, span);
+                }
+                let start = self.here();
+                self.loops.push(LoopContext {
+                    depth: self.depth,
+                    break_patches: vec![],
+                    continue_target: None,
+                    continue_patches: vec![],
+                });
+                let to_end = match cond {
+                    Some(cond) => {
+                        self.compile(*cond)?;
+                        Some(self.emit(Op::JumpIfFalse(0), span))
+                    }
+                    None => None,
+                };
+                self.compile(*body)?;
+                self.emit(Op::Pop, span);
+                // `continue` lands on the step expression, not the condition.
+                let continue_target = self.here();
+                if let Some(step) = step {
+                    self.compile(*step)?;
+                    self.emit(Op::Pop, span);
+                }
+                self.emit(Op::Jump(start), span);
+                if let Some(at) = to_end {
+                    self.patch_jump(at);
+                }
+                let ctx = self.loops.pop().unwrap();
+                for at in ctx.break_patches {
+                    self.patch_jump(at);
+                }
+                for at in ctx.continue_patches {
+                    match &mut self.chunk.code[at] {
+                        Op::Jump(t) => *t = continue_target,
+                        _ => unreachable!(),
+                    }
+                }
+                self.depth -= 1;
+                self.emit(Op::PopScope, span);
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Break(span) => {
+                if self.loops.is_empty() {
+                    error!(span, "Break statement outside of loop")
+                }
+                self.emit_scope_unwind(span);
+                let at = self.emit(Op::Jump(0), span);
+                self.loops.last_mut().unwrap().break_patches.push(at);
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Continue(span) => {
+                if self.loops.is_empty() {
+                    error!(span, "Continue statement outside of loop")
+                }
+                self.emit_scope_unwind(span);
+                match self.loops.last().unwrap().continue_target {
+                    Some(target) => {
+                        self.emit(Op::Jump(target), span);
+                    }
+                    None => {
+                        let at = self.emit(Op::Jump(0), span);
+                        self.loops.last_mut().unwrap().continue_patches.push(at);
+                    }
+                }
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Function {
+                span,
+                name,
+                args,
+                body,
+                ..
+            } => {
+                let idx = self.chunk.functions.len() as u16;
+                self.chunk.functions.push(Rc::new(FunctionProto {
+                    span: *span,
+                    name: name.clone(),
+                    args: args.clone(),
+                    body: *body,
+                }));
+                self.emit(Op::MakeFunction(idx), span);
+            }
+
+            AST::Call(span, func, args) => {
+                self.compile(*func)?;
+                for arg in args {
+                    self.compile(*arg)?;
+                }
+                self.emit(Op::Call(args.len() as u16), span);
+            }
+
+            AST::Return(span, expr) => {
+                if !self.in_function {
+                    error!(span, "Return statement outside of function")
+                }
+                // `return f(...)` replaces the current frame; see Op::TailCall.
+                if let AST::Call(_, func, args) = &ast[*expr] {
+                    self.compile(*func)?;
+                    for arg in args {
+                        self.compile(*arg)?;
+                    }
+                    self.emit(Op::TailCall(args.len() as u16), span);
+                } else {
+                    self.compile(*expr)?;
+                    self.emit(Op::Return, span);
+                }
+            }
+
+            AST::Assert(span, cond) => {
+                self.compile(*cond)?;
+                self.emit(Op::Assert, span);
+                self.emit_constant(Value::Nothing, span)?;
+            }
+
+            AST::Index(span, left, right) => {
+                self.compile(*left)?;
+                self.compile(*right)?;
+                self.emit(Op::Index, span);
+            }
+
+            AST::Slice {
+                span,
+                lhs,
+                start,
+                end,
+                step,
+            } => {
+                self.compile(*lhs)?;
+                for part in [start, end, step].into_iter().flatten() {
+                    self.compile(*part)?;
+                }
+                self.emit(
+                    Op::Slice {
+                        has_start: start.is_some(),
+                        has_end: end.is_some(),
+                        has_step: step.is_some(),
+                    },
+                    span,
+                );
+            }
+
+            AST::Range(span, start, end) => {
+                self.compile(*start)?;
+                self.compile(*end)?;
+                self.emit(Op::MakeRange, span);
+            }
+
+            AST::ArrayLiteral(span, items) => {
+                for item in items {
+                    self.compile(*item)?;
+                }
+                self.emit(Op::MakeArray(items.len() as u16), span);
+            }
+            AST::DictLiteral(span, pairs) => {
+                for (key, value) in pairs {
+                    self.compile(*key)?;
+                    self.compile(*value)?;
+                }
+                self.emit(Op::MakeDict(pairs.len() as u16), span);
+            }
+
+            AST::ParForEach(span, var, iterable, body) => {
+                let (var, iterable, body) = (*var, *iterable, *body);
+                self.compile(iterable)?;
+                let idx = self.name(var, span)?;
+                self.emit(Op::ParFor(idx, body), span);
+            }
+
+            AST::Import(span, path) => {
+                let idx = self.name(Symbol::intern(path), span)?;
+                self.emit(Op::Import(idx), span);
+            }
+
+            AST::PostIncrement(span, expr, offset) => {
+                self.compile_increment(*expr, *offset, true, span)?;
+            }
+            AST::PreIncrement(span, expr, offset) => {
+                self.compile_increment(*expr, *offset, false, span)?;
+            }
+        }
+        Ok(())
+    }
+
+    fn compile_binop(&mut self, op: BinOp, left: NodeId, right: NodeId, span: &Span) -> Result<()> {
+        self.compile(left)?;
+        self.compile(right)?;
+        self.emit(Op::BinaryOp(op), span);
+        Ok(())
+    }
+
+    fn compile_assign_target(&mut self, lhs: NodeId, span: &Span) -> Result<()> {
+        match &self.ast[lhs] {
+            AST::Variable(span, name, _) => {
+                let span = *span;
+                let idx = self.name(*name, &span)?;
+                self.emit(Op::SetVar(idx), &span);
+                Ok(())
+            }
+            // The dup'd value is under the container and index; `SetIndex`
+            // consumes all three and leaves the value as the expression
+            // result.
+            AST::Index(span, lhs, index) => {
+                let (span, lhs, index) = (*span, *lhs, *index);
+                self.compile(lhs)?;
+                self.compile(index)?;
+                self.emit(Op::SetIndex, &span);
+                Ok(())
+            }
+            _ => error!(span, "Invalid assignment target"),
+        }
+    }
+
+    fn compile_increment(&mut self, expr: NodeId, offset: i64, push_old: bool, span: &Span) -> Result<()> {
+        match &self.ast[expr] {
+            AST::Variable(_, name, _) => {
+                let name = *name;
+                let idx = self.name(name, span)?;
+                self.emit(Op::IncVar(idx, offset, push_old), span);
+                Ok(())
+            }
+            // `arr[i]++`: the container and index are evaluated once and
+            // consumed by a single read-modify-write op.
+            AST::Index(_, left, right) => {
+                let (left, right) = (*left, *right);
+                self.compile(left)?;
+                self.compile(right)?;
+                self.emit(Op::IncIndex(offset, push_old), span);
+                Ok(())
+            }
+            _ => error!(span, "Invalid assignment target"),
+        }
+    }
+}
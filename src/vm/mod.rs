@@ -0,0 +1,605 @@
+use crate::common::{make, Ref, Span};
+use crate::error::{runtime_error as error, Result};
+use crate::interpreter::value::{Function, IteratorValue, Value};
+use crate::interpreter::{BuiltIn, Scope};
+use crate::symbol::Symbol;
+use std::cell::Cell;
+use std::collections::HashMap;
+use std::rc::Rc;
+
+pub mod compiler;
+
+/// A single VM instruction. Jump targets are absolute indices into the chunk.
+#[derive(Debug, Clone, Copy)]
+pub enum Op {
+    Constant(u16),
+    Dup,
+    Pop,
+    GetVar(u16),
+    SetVar(u16),
+    Declare(u16),
+    PushScope,
+    PopScope,
+    MakeFunction(u16),
+    Call(u16),
+    /// `return f(...)`: replaces the current frame instead of stacking one.
+    TailCall(u16),
+    Return,
+    Not,
+    BinaryOp(BinOp),
+    Jump(usize),
+    JumpIfFalse(usize),
+    MakeArray(u16),
+    MakeDict(u16),
+    MakeRange,
+    Index,
+    SetIndex,
+    /// Duplicate the top two stack slots (the container and index of a
+    /// read-modify-write).
+    Dup2,
+    /// `SetIndex` with the value above the container and index instead of
+    /// beneath them; leaves the stored value as the result.
+    StoreIndex,
+    Slice {
+        has_start: bool,
+        has_end: bool,
+        has_step: bool,
+    },
+    GetIter,
+    IterNext(usize),
+    IncVar(u16, i64, bool),
+    IncIndex(i64, bool),
+    ParFor(u16, crate::ast::NodeId),
+    /// Import the module whose path is the named string; the index is into
+    /// `names`.
+    Import(u16),
+    Append(u16),
+    Assert,
+}
+
+#[derive(Debug, Clone, Copy)]
+pub enum BinOp {
+    Add,
+    Sub,
+    Mul,
+    Div,
+    And,
+    Or,
+    Eq,
+    Ne,
+    Lt,
+    Gt,
+    Le,
+    Ge,
+}
+
+/// An uninstantiated function: everything except the captured scope, which is
+/// only known when the `MakeFunction` instruction executes.
+#[derive(Debug)]
+pub struct FunctionProto {
+    pub span: Span,
+    pub name: Option<Symbol>,
+    pub args: Vec<Symbol>,
+    pub body: crate::ast::NodeId,
+}
+
+/// What a `BinaryOp` site has seen so far. Each site starts `Unseen`, tags
+/// itself with the first operand type pair it executes with, and from then
+/// on a monomorphic site skips the generic `Value` method cross-product and
+/// runs the unboxed operation directly. A site that observes a different
+/// pair re-tags itself, so polymorphic sites just pay one extra check.
+#[derive(Debug, Clone, Copy, PartialEq)]
+pub enum InlineCache {
+    Unseen,
+    IntInt,
+    FloatFloat,
+    Generic,
+}
+
+/// The monomorphic `i64 op i64` handlers. `And`/`Or` are truthiness-based
+/// and stay on the generic path.
+fn int_int_op(binop: BinOp, left: i64, right: i64) -> Option<Value> {
+    Some(match binop {
+        BinOp::Add => Value::Integer(left + right),
+        BinOp::Sub => Value::Integer(left - right),
+        BinOp::Mul => Value::Integer(left * right),
+        BinOp::Div => Value::Integer(left / right),
+        BinOp::Eq => Value::Boolean(left == right),
+        BinOp::Ne => Value::Boolean(left != right),
+        BinOp::Lt => Value::Boolean(left < right),
+        BinOp::Gt => Value::Boolean(left > right),
+        BinOp::Le => Value::Boolean(left <= right),
+        BinOp::Ge => Value::Boolean(left >= right),
+        BinOp::And | BinOp::Or => return None,
+    })
+}
+
+/// The monomorphic `f64 op f64` handlers.
+fn float_float_op(binop: BinOp, left: f64, right: f64) -> Option<Value> {
+    Some(match binop {
+        BinOp::Add => Value::Float(left + right),
+        BinOp::Sub => Value::Float(left - right),
+        BinOp::Mul => Value::Float(left * right),
+        BinOp::Div => Value::Float(left / right),
+        BinOp::Eq => Value::Boolean(left == right),
+        BinOp::Ne => Value::Boolean(left != right),
+        BinOp::Lt => Value::Boolean(left < right),
+        BinOp::Gt => Value::Boolean(left > right),
+        BinOp::Le => Value::Boolean(left <= right),
+        BinOp::Ge => Value::Boolean(left >= right),
+        BinOp::And | BinOp::Or => return None,
+    })
+}
+
+/// A flat compiled unit: the whole program, or one function body.
+#[derive(Debug)]
+pub struct Chunk {
+    pub code: Vec<Op>,
+    pub spans: Vec<Span>,
+    /// One inline cache per instruction; only `BinaryOp` sites use theirs.
+    pub caches: Vec<Cell<InlineCache>>,
+    pub constants: Vec<Value>,
+    pub names: Vec<Symbol>,
+    pub functions: Vec<Rc<FunctionProto>>,
+    /// The arena the chunk was compiled from; function bodies in
+    /// `functions` index into it.
+    pub ast: Rc<crate::ast::Ast>,
+}
+
+impl Chunk {
+    pub fn new(ast: Rc<crate::ast::Ast>) -> Chunk {
+        Chunk {
+            code: vec![],
+            spans: vec![],
+            caches: vec![],
+            constants: vec![],
+            names: vec![],
+            functions: vec![],
+            ast,
+        }
+    }
+}
+
+struct Frame {
+    chunk: Rc<Chunk>,
+    ip: usize,
+    scope: Ref<Scope>,
+    /// Value-stack height at frame entry. A `return` can fire with loop
+    /// state (iterators, dup'd values) still on the stack, so returning
+    /// truncates back to this watermark.
+    base: usize,
+}
+
+/// Default cap on serpens call depth; see `Vm::set_recursion_limit`.
+const DEFAULT_RECURSION_LIMIT: usize = 1000;
+
+pub struct Vm {
+    stack: Vec<Value>,
+    frames: Vec<Frame>,
+    builtins: HashMap<Symbol, &'static BuiltIn>,
+    recursion_limit: usize,
+    /// Checked once at construction; see `profiler::enabled`.
+    profiling: bool,
+}
+
+impl Vm {
+    pub fn new() -> Vm {
+        Vm {
+            stack: vec![],
+            frames: vec![],
+            builtins: crate::interpreter::default_builtins()
+                .into_iter()
+                .map(|(name, builtin)| (Symbol::intern(name), builtin))
+                .collect(),
+            recursion_limit: DEFAULT_RECURSION_LIMIT,
+            profiling: crate::profiler::enabled(),
+        }
+    }
+
+    /// Cap serpens call depth so runaway recursion raises a runtime error
+    /// instead of exhausting memory on frames.
+    pub fn set_recursion_limit(&mut self, limit: usize) {
+        self.recursion_limit = limit;
+    }
+
+    pub fn run(&mut self, chunk: Rc<Chunk>) -> Result<()> {
+        let global_scope = Scope::new(None, false);
+        self.frames.push(Frame {
+            chunk,
+            ip: 0,
+            scope: global_scope,
+            base: 0,
+        });
+
+        'frames: while let Some(frame) = self.frames.last() {
+            let chunk = frame.chunk.clone();
+            let mut ip = frame.ip;
+
+            while ip < chunk.code.len() {
+                let op = chunk.code[ip];
+                let span = chunk.spans[ip];
+                ip += 1;
+                if self.profiling {
+                    crate::profiler::tick(&span);
+                }
+
+                match op {
+                    Op::Constant(idx) => self.stack.push(chunk.constants[idx as usize].clone()),
+                    Op::Dup => {
+                        let top = self.stack.last().expect("stack underflow").clone();
+                        self.stack.push(top);
+                    }
+                    Op::Pop => {
+                        self.stack.pop();
+                    }
+                    Op::GetVar(idx) => {
+                        let name = chunk.names[idx as usize];
+                        if let Some(builtin) = self.builtins.get(&name) {
+                            self.stack.push(Value::BuiltInFunction(builtin));
+                        } else if let Some(value) = self.scope().borrow().get(name) {
+                            self.stack.push(value);
+                        } else {
+                            error!(span, "Variable {} not found", name)
+                        }
+                    }
+                    Op::SetVar(idx) => {
+                        let name = chunk.names[idx as usize];
+                        if self.scope().borrow().get(name).is_none() {
+                            error!(span, "Variable {} doesn't exist", name)
+                        }
+                        if self.builtins.contains_key(&name) {
+                            error!(span, "`{}` is a built-in function, can't override it", name)
+                        }
+                        let value = self.stack.pop().expect("stack underflow");
+                        self.scope().borrow_mut().insert(name, value, true, &span)?;
+                    }
+                    Op::Declare(idx) => {
+                        let name = chunk.names[idx as usize];
+                        if self.builtins.contains_key(&name) {
+                            error!(
+                                span,
+                                "`{}` is a built-in function, can't be used as a variable", name
+                            )
+                        }
+                        let value = self.stack.pop().expect("stack underflow");
+                        self.scope().borrow_mut().insert(name, value, false, &span)?;
+                    }
+                    Op::PushScope => {
+                        let frame = self.frames.last_mut().unwrap();
+                        let in_function = frame.scope.borrow().in_function;
+                        frame.scope = Scope::new(Some(frame.scope.clone()), in_function);
+                    }
+                    Op::PopScope => {
+                        let frame = self.frames.last_mut().unwrap();
+                        let parent = frame
+                            .scope
+                            .borrow()
+                            .parent
+                            .clone()
+                            .expect("popped the global scope");
+                        frame.scope = parent;
+                    }
+                    Op::MakeFunction(idx) => {
+                        let proto = &chunk.functions[idx as usize];
+                        let func_ref = make!(Function {
+                            span: proto.span,
+                            name: proto
+                                .name
+                                .map_or_else(|| "<anon>".to_string(), |name| name.to_string()),
+                            args: proto.args.clone(),
+                            ast: chunk.ast.clone(),
+                            body: proto.body,
+                            scope: self.scope(),
+                            chunk: None,
+                        });
+                        crate::interpreter::gc::track(&func_ref);
+                        let func = Value::Function(func_ref);
+                        if let Some(name) = proto.name {
+                            self.scope()
+                                .borrow_mut()
+                                .insert(name, func.clone(), false, &span)?;
+                        }
+                        self.stack.push(func);
+                    }
+                    Op::Call(arg_count) | Op::TailCall(arg_count) => {
+                        let is_tail = matches!(op, Op::TailCall(_));
+                        let args = self
+                            .stack
+                            .split_off(self.stack.len() - arg_count as usize);
+                        let callee = self.stack.pop().expect("stack underflow");
+                        match callee {
+                            Value::Function(func) => {
+                                if args.len() != func.borrow().args.len() {
+                                    error!(
+                                        span,
+                                        "Expected {} arguments, got {}",
+                                        func.borrow().args.len(),
+                                        args.len()
+                                    )
+                                }
+                                let new_scope =
+                                    Scope::new(Some(func.borrow().scope.clone()), true);
+                                for (arg, value) in func.borrow().args.iter().zip(args) {
+                                    new_scope.borrow_mut().insert(*arg, value, false, &span)?;
+                                }
+                                let func_chunk = match &func.borrow().chunk {
+                                    Some(chunk) => chunk.clone(),
+                                    None => {
+                                        let (ast, body) = {
+                                            let func = func.borrow();
+                                            (func.ast.clone(), func.body)
+                                        };
+                                        Rc::new(compiler::Compiler::compile_function(&ast, body)?)
+                                    }
+                                };
+                                func.borrow_mut().chunk = Some(func_chunk.clone());
+                                if self.profiling {
+                                    if is_tail {
+                                        crate::profiler::leave_function();
+                                    }
+                                    crate::profiler::enter_function(func.borrow().name.clone());
+                                }
+                                let base = if is_tail {
+                                    // The caller is done; reuse its frame
+                                    // slot and discard its leftover stack.
+                                    let base = self.frames.last().unwrap().base;
+                                    self.frames.pop();
+                                    self.stack.truncate(base);
+                                    base
+                                } else {
+                                    self.frames.last_mut().unwrap().ip = ip;
+                                    self.stack.len()
+                                };
+                                if self.frames.len() >= self.recursion_limit {
+                                    error!(
+                                        span,
+                                        "Maximum recursion depth ({}) exceeded",
+                                        self.recursion_limit
+                                    )
+                                }
+                                self.frames.push(Frame {
+                                    chunk: func_chunk,
+                                    ip: 0,
+                                    scope: new_scope,
+                                    base,
+                                });
+                                continue 'frames;
+                            }
+                            Value::BuiltInFunction(builtin) => {
+                                let result = (builtin.func)(&span, args)?;
+                                if is_tail {
+                                    // A tail call to a builtin is just a
+                                    // return: hand the result to the caller
+                                    // rather than the remains of this frame.
+                                    if self.profiling {
+                                        crate::profiler::leave_function();
+                                    }
+                                    let base = self.frames.last().unwrap().base;
+                                    self.frames.pop();
+                                    self.stack.truncate(base);
+                                    self.stack.push(result);
+                                    continue 'frames;
+                                }
+                                self.stack.push(result);
+                            }
+                            x => error!(span, "Can't call object {:?}", x),
+                        }
+                    }
+                    Op::Return => {
+                        if self.profiling {
+                            crate::profiler::leave_function();
+                        }
+                        // The return value stays on the stack for the caller;
+                        // anything else this frame left (e.g. a live loop
+                        // iterator) is discarded.
+                        let value = self.stack.pop().expect("stack underflow");
+                        let base = self.frames.last().unwrap().base;
+                        self.frames.pop();
+                        self.stack.truncate(base);
+                        self.stack.push(value);
+                        continue 'frames;
+                    }
+                    Op::Not => {
+                        let val = self.stack.pop().expect("stack underflow");
+                        self.stack.push(val.not(&span)?);
+                    }
+                    Op::BinaryOp(binop) => {
+                        let right = self.stack.pop().expect("stack underflow");
+                        let left = self.stack.pop().expect("stack underflow");
+                        let cache = &chunk.caches[ip - 1];
+                        let fast = match (cache.get(), &left, &right) {
+                            (InlineCache::IntInt, Value::Integer(l), Value::Integer(r)) => {
+                                int_int_op(binop, *l, *r)
+                            }
+                            (InlineCache::FloatFloat, Value::Float(l), Value::Float(r)) => {
+                                float_float_op(binop, *l, *r)
+                            }
+                            _ => None,
+                        };
+                        if let Some(result) = fast {
+                            self.stack.push(result);
+                            continue;
+                        }
+                        cache.set(match (&left, &right) {
+                            (Value::Integer(_), Value::Integer(_)) => InlineCache::IntInt,
+                            (Value::Float(_), Value::Float(_)) => InlineCache::FloatFloat,
+                            _ => InlineCache::Generic,
+                        });
+                        let result = match binop {
+                            BinOp::Add => left.plus(&right, &span)?,
+                            BinOp::Sub => left.minus(&right, &span)?,
+                            BinOp::Mul => left.multiply(&right, &span)?,
+                            BinOp::Div => left.divide(&right, &span)?,
+                            BinOp::And => left.and(&right, &span)?,
+                            BinOp::Or => left.or(&right, &span)?,
+                            BinOp::Eq => left.equals(&right, &span)?,
+                            BinOp::Ne => left.not_equals(&right, &span)?,
+                            BinOp::Lt => left.less_than(&right, &span)?,
+                            BinOp::Gt => left.greater_than(&right, &span)?,
+                            BinOp::Le => left.less_equals(&right, &span)?,
+                            BinOp::Ge => left.greater_equals(&right, &span)?,
+                        };
+                        self.stack.push(result);
+                    }
+                    Op::Jump(target) => ip = target,
+                    Op::JumpIfFalse(target) => {
+                        let cond = self.stack.pop().expect("stack underflow");
+                        match cond {
+                            Value::Boolean(true) => {}
+                            Value::Boolean(false) => ip = target,
+                            _ => error!(span, "Condition must be a boolean"),
+                        }
+                    }
+                    Op::MakeArray(count) => {
+                        let items = self
+                            .stack
+                            .split_off(self.stack.len() - count as usize);
+                        self.stack.push(Value::Array(make!(items)));
+                    }
+                    Op::MakeDict(count) => {
+                        let items = self
+                            .stack
+                            .split_off(self.stack.len() - 2 * count as usize);
+                        let mut map = crate::interpreter::value::Dict::default();
+                        let mut items = items.into_iter();
+                        while let (Some(key), Some(value)) = (items.next(), items.next()) {
+                            map.insert(key.dict_key(&span)?, value);
+                        }
+                        self.stack.push(Value::Dict(make!(map)));
+                    }
+                    Op::MakeRange => {
+                        let end = self.stack.pop().expect("stack underflow");
+                        let start = self.stack.pop().expect("stack underflow");
+                        self.stack.push(Value::create_range(&start, &end, &span)?);
+                    }
+                    Op::Index => {
+                        let index = self.stack.pop().expect("stack underflow");
+                        let value = self.stack.pop().expect("stack underflow");
+                        self.stack.push(value.index(&index, &span)?);
+                    }
+                    Op::SetIndex => {
+                        let index = self.stack.pop().expect("stack underflow");
+                        let target = self.stack.pop().expect("stack underflow");
+                        let value = self.stack.pop().expect("stack underflow");
+                        target.set_index(&index, value, &span)?;
+                    }
+                    Op::Dup2 => {
+                        let len = self.stack.len();
+                        let target = self.stack[len - 2].clone();
+                        let index = self.stack[len - 1].clone();
+                        self.stack.push(target);
+                        self.stack.push(index);
+                    }
+                    Op::StoreIndex => {
+                        let value = self.stack.pop().expect("stack underflow");
+                        let index = self.stack.pop().expect("stack underflow");
+                        let target = self.stack.pop().expect("stack underflow");
+                        target.set_index(&index, value.clone(), &span)?;
+                        self.stack.push(value);
+                    }
+                    Op::Slice {
+                        has_start,
+                        has_end,
+                        has_step,
+                    } => {
+                        let step = if has_step { self.stack.pop() } else { None };
+                        let end = if has_end { self.stack.pop() } else { None };
+                        let start = if has_start { self.stack.pop() } else { None };
+                        let value = self.stack.pop().expect("stack underflow");
+                        self.stack.push(value.slice(start, end, step, &span)?);
+                    }
+                    Op::GetIter => {
+                        let value = self.stack.pop().expect("stack underflow");
+                        self.stack.push(value.iterator(&span)?);
+                    }
+                    Op::IterNext(target) => {
+                        let next = match self.stack.last().expect("stack underflow") {
+                            Value::Iterator(IteratorValue(iter)) => iter.borrow_mut().next(),
+                            _ => error!(span, "For loop must iterate over an iterable"),
+                        };
+                        match next {
+                            Some(value) => self.stack.push(value?),
+                            None => ip = target,
+                        }
+                    }
+                    Op::IncVar(idx, offset, push_old) => {
+                        let name = chunk.names[idx as usize];
+                        let old = match self.scope().borrow().get(name) {
+                            Some(value) => value,
+                            None => error!(span, "Variable {} not found", name),
+                        };
+                        let new = match &old {
+                            Value::Integer(val) => Value::Integer(*val + offset),
+                            _ => error!(span, "Operation only supported for integers"),
+                        };
+                        self.scope()
+                            .borrow_mut()
+                            .insert(name, new.clone(), true, &span)?;
+                        self.stack.push(if push_old { old } else { new });
+                    }
+                    Op::Import(idx) => {
+                        let path = chunk.names[idx as usize];
+                        let bindings =
+                            crate::module::import(span.0.filename, path.as_str(), &span)?;
+                        let scope = self.scope();
+                        let mut scope = scope.borrow_mut();
+                        for (name, value) in bindings {
+                            scope.insert(name, value, false, &span)?;
+                        }
+                        self.stack.push(Value::Nothing);
+                    }
+                    Op::ParFor(idx, body) => {
+                        let name = chunk.names[idx as usize];
+                        let iterable = self.stack.pop().expect("stack underflow");
+                        let result = crate::interpreter::par::run_par_for(
+                            &chunk.ast,
+                            body,
+                            name,
+                            iterable,
+                            &span,
+                        )?;
+                        self.stack.push(result);
+                    }
+                    Op::IncIndex(offset, push_old) => {
+                        let index = self.stack.pop().expect("stack underflow");
+                        let target = self.stack.pop().expect("stack underflow");
+                        let old = target.index(&index, &span)?;
+                        let new = match &old {
+                            Value::Integer(val) => Value::Integer(*val + offset),
+                            _ => error!(span, "Operation only supported for integers"),
+                        };
+                        target.set_index(&index, new.clone(), &span)?;
+                        self.stack.push(if push_old { old } else { new });
+                    }
+                    Op::Append(idx) => {
+                        let name = chunk.names[idx as usize];
+                        let right = self.stack.pop().expect("stack underflow");
+                        let left = self.stack.pop().expect("stack underflow");
+                        let scope = self.scope();
+                        let result = Value::append(left, &right, &span, || {
+                            scope.borrow_mut().insert(name, Value::Nothing, true, &span)
+                        })?;
+                        scope.borrow_mut().insert(name, result.clone(), true, &span)?;
+                        self.stack.push(result);
+                    }
+                    Op::Assert => {
+                        let cond = self.stack.pop().expect("stack underflow");
+                        match cond {
+                            Value::Boolean(true) => {}
+                            Value::Boolean(false) => error!(span, "Assertion failed"),
+                            _ => error!(span, "Assertion condition must be a boolean"),
+                        }
+                    }
+                }
+            }
+
+            // Fell off the end of the top-level chunk.
+            self.frames.pop();
+        }
+        Ok(())
+    }
+
+    fn scope(&self) -> Ref<Scope> {
+        self.frames.last().expect("no active frame").scope.clone()
+    }
+}